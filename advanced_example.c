@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <float.h>
 #include "rbtree.h"
 #include "rbtree_utils.h"
 
@@ -71,24 +72,30 @@ typedef struct {
     double min_salary;
 } salary_stats_t;
 
-/* Visitor function to calculate salary statistics */
-void calculate_salary_stats(void *data, void *context) {
+static const salary_stats_t no_salaries = {0.0, 0, -DBL_MAX, DBL_MAX};
+
+/* Salary statistics kept per subtree, so any ID range is O(log n) */
+void salary_stats_value(void *out, const void *data) {
     const employee_t *emp = (const employee_t *)data;
-    salary_stats_t *stats = (salary_stats_t *)context;
-    
-    stats->total_salary += emp->salary;
-    stats->count++;
+    salary_stats_t *stats = (salary_stats_t *)out;
     
-    if (stats->count == 1) {
-        stats->max_salary = emp->salary;
-        stats->min_salary = emp->salary;
-    } else {
-        if (emp->salary > stats->max_salary) {
-            stats->max_salary = emp->salary;
-        }
-        if (emp->salary < stats->min_salary) {
-            stats->min_salary = emp->salary;
-        }
+    stats->total_salary = emp->salary;
+    stats->count = 1;
+    stats->max_salary = emp->salary;
+    stats->min_salary = emp->salary;
+}
+
+void salary_stats_combine(void *acc, const void *next) {
+    salary_stats_t *stats = (salary_stats_t *)acc;
+    const salary_stats_t *other = (const salary_stats_t *)next;
+    
+    stats->total_salary += other->total_salary;
+    stats->count += other->count;
+    if (other->max_salary > stats->max_salary) {
+        stats->max_salary = other->max_salary;
+    }
+    if (other->min_salary < stats->min_salary) {
+        stats->min_salary = other->min_salary;
     }
 }
 
@@ -192,24 +199,37 @@ void demo_iterator() {
     }
     
     /* Iterate through tree */
-    rb_iterator_t *iter = rb_iterator_create(tree);
+    rb_iterator_t iter;
+    rb_iterator_init(&iter, tree);
     
     printf("Forward iteration:\n");
-    void *data = rb_iterator_first(iter);
+    void *data = rb_iterator_first(&iter);
     while (data) {
         const employee_t *emp = (const employee_t *)data;
         printf("  %d: %s\n", emp->id, emp->name);
-        data = rb_iterator_next(iter);
+        data = rb_iterator_next(&iter);
+    }
+    
+    printf("Backward iteration (last three):\n");
+    data = rb_iterator_last(&iter);
+    for (int i = 0; i < 3 && data; i++) {
+        const employee_t *emp = (const employee_t *)data;
+        printf("  %d: %s\n", emp->id, emp->name);
+        data = rb_iterator_prev(&iter);
     }
     
-    rb_iterator_destroy(iter);
     rb_tree_destroy(tree);
 }
 
 void demo_salary_analysis() {
     printf("\n=== Salary Analysis Demo ===\n");
     
-    rb_tree_t *company = rb_tree_create(employee_compare, free);
+    rb_tree_config_t config = {0};
+    config.augment.size = sizeof(salary_stats_t);
+    config.augment.identity = &no_salaries;
+    config.augment.value = salary_stats_value;
+    config.augment.combine = salary_stats_combine;
+    rb_tree_t *company = rb_tree_create_ex(employee_compare, free, &config);
     
     /* Add employees with varying salaries */
     rb_insert(company, create_employee(1001, "Alice", "Engineering", 95000, 7));
@@ -220,9 +240,9 @@ void demo_salary_analysis() {
     rb_insert(company, create_employee(1006, "Frank", "Sales", 58000, 2));
     rb_insert(company, create_employee(1007, "Grace", "HR", 67000, 6));
     
-    /* Calculate salary statistics */
-    salary_stats_t salary_stats = {0.0, 0, 0.0, 0.0};
-    rb_inorder_walk(company, calculate_salary_stats, &salary_stats);
+    /* Whole-company statistics come straight from the root */
+    salary_stats_t salary_stats;
+    rb_aggregate_range(company, NULL, NULL, &salary_stats);
     
     printf("Salary Analysis:\n");
     printf("  Total employees: %d\n", salary_stats.count);
@@ -231,6 +251,18 @@ void demo_salary_analysis() {
     printf("  Lowest salary:  $%.2f\n", salary_stats.min_salary);
     printf("  Total payroll:  $%.2f\n", salary_stats.total_salary);
     
+    /* A raise edits the payload in place, so the aggregates are refreshed */
+    employee_t key = {1003, "", "", 0, 0};
+    employee_t *carol = rb_search(company, &key);
+    carol->salary *= 1.10;
+    rb_aggregate_refresh(company, &key);
+    
+    employee_t first = {1002, "", "", 0, 0};
+    employee_t last = {1005, "", "", 0, 0};
+    rb_aggregate_range(company, &first, &last, &salary_stats);
+    printf("  IDs 1002-1005 after Carol's raise: %d staff, payroll $%.2f\n",
+           salary_stats.count, salary_stats.total_salary);
+    
     /* Count by department */
     dept_filter_t eng_filter = {"Engineering", 0};
     rb_inorder_walk(company, count_by_department, &eng_filter);
@@ -297,6 +329,35 @@ void demo_memory_analysis() {
     rb_tree_destroy(tree);
 }
 
+void demo_transfer() {
+    printf("\n=== Transfer Demo ===\n");
+    
+    rb_tree_t *engineering = rb_tree_create(employee_compare, free);
+    rb_tree_t *sales = rb_tree_create(employee_compare, free);
+    
+    rb_insert(engineering, create_employee(2001, "Hank Green", "Engineering", 88000, 7));
+    rb_insert(engineering, create_employee(2002, "Ivy Chen", "Engineering", 95000, 9));
+    rb_insert(engineering, create_employee(2003, "Jack White", "Engineering", 72000, 2));
+    rb_insert(sales, create_employee(3001, "Kate Black", "Sales", 61000, 4));
+    
+    /* Move the record and its node to the other tree: no clone, no free */
+    employee_t key = {.id = 2003};
+    rb_node_t *node = NULL;
+    employee_t *moved = rb_extract(engineering, &key, &node);
+    if (moved) {
+        strcpy(moved->department, "Sales");
+        rb_insert_node(sales, node);
+    }
+    
+    printf("Engineering after transfer:\n");
+    rb_inorder_walk(engineering, print_employee_detailed, NULL);
+    printf("Sales after transfer:\n");
+    rb_inorder_walk(sales, print_employee_detailed, NULL);
+    
+    rb_tree_destroy(engineering);
+    rb_tree_destroy(sales);
+}
+
 int main() {
     printf("Advanced Red-Black Tree Demonstration\n");
     printf("====================================\n");
@@ -308,6 +369,7 @@ int main() {
     demo_salary_analysis();
     demo_range_operations();
     demo_memory_analysis();
+    demo_transfer();
     
     printf("\nAll demonstrations completed successfully!\n");
     return 0;
@@ -3,8 +3,12 @@
 #include <string.h>
 #include <time.h>
 #include <math.h>
+#include <stdint.h>
 #include "rbtree.h"
 #include "rbtree_utils.h"
+#include "rbtree_index.h"
+#include "rbtree_arena.h"
+#include "rbtree_frozen.h"
 
 /* Benchmark configuration */
 #define MAX_BENCHMARK_SIZE 100000
@@ -89,10 +93,25 @@ void benchmark_insertion() {
 }
 
 /* Benchmark search performance */
+static int run_searches(rb_tree_t *tree, const int *keys, int count, double *elapsed) {
+    timer_t timer;
+    int hits = 0;
+    
+    timer_start(&timer);
+    for (int i = 0; i < count; i++) {
+        void *result = rb_search(tree, &keys[i]);
+        if (result) hits++;
+    }
+    timer_stop(&timer);
+    
+    *elapsed = timer.elapsed;
+    return hits;
+}
+
 void benchmark_search() {
     printf("\n=== Search Benchmark ===\n");
-    printf("Size     | Time (s) | Searches/sec | Hit Rate\n");
-    printf("---------|----------|--------------|----------\n");
+    printf("Size     | Time (s) | Searches/sec | Hit Rate | Compacted (s) | Searches/sec\n");
+    printf("---------|----------|--------------|----------|---------------|-------------\n");
     
     int sizes[] = {1000, 5000, 10000, 50000, 100000};
     int num_sizes = sizeof(sizes) / sizeof(sizes[0]);
@@ -100,10 +119,16 @@ void benchmark_search() {
     for (int s = 0; s < num_sizes; s++) {
         rb_tree_t *tree = rb_tree_create(int_compare, free);
         
-        /* Populate tree */
+        /* Populate tree with churn so nodes are scattered over the heap */
         for (int i = 0; i < sizes[s]; i++) {
             int *value = create_int(i);
             rb_insert(tree, value);
+            int *noise = create_int(sizes[s] * 4 + i);
+            rb_insert(tree, noise);
+        }
+        for (int i = 0; i < sizes[s]; i++) {
+            int noise = sizes[s] * 4 + i;
+            rb_delete(tree, &noise);
         }
         
         /* Prepare random search keys */
@@ -112,24 +137,20 @@ void benchmark_search() {
             search_keys[i] = rand() % (sizes[s] * 2); /* 50% hit rate */
         }
         
-        timer_t timer;
-        int hits = 0;
-        
-        timer_start(&timer);
-        
-        /* Perform searches */
-        for (int i = 0; i < NUM_SEARCH_OPS; i++) {
-            void *result = rb_search(tree, &search_keys[i]);
-            if (result) hits++;
-        }
+        double elapsed, compact_elapsed;
+        int hits = run_searches(tree, search_keys, NUM_SEARCH_OPS, &elapsed);
         
-        timer_stop(&timer);
+        /* Same searches after relayout into van Emde Boas order */
+        rb_tree_compact(tree, RB_LAYOUT_VEB);
+        run_searches(tree, search_keys, NUM_SEARCH_OPS, &compact_elapsed);
         
-        double searches_per_sec = NUM_SEARCH_OPS / timer.elapsed;
+        double searches_per_sec = NUM_SEARCH_OPS / elapsed;
+        double compact_per_sec = NUM_SEARCH_OPS / compact_elapsed;
         double hit_rate = (double)hits / NUM_SEARCH_OPS * 100.0;
         
-        printf("%8d | %8.4f | %12.0f | %7.1f%%\n",
-               sizes[s], timer.elapsed, searches_per_sec, hit_rate);
+        printf("%8d | %8.4f | %12.0f | %7.1f%% | %13.4f | %12.0f\n",
+               sizes[s], elapsed, searches_per_sec, hit_rate,
+               compact_elapsed, compact_per_sec);
         
         free(search_keys);
         rb_tree_destroy(tree);
@@ -200,32 +221,46 @@ void benchmark_deletion() {
 }
 
 /* Memory usage benchmark */
+static size_t int_payload_size(const void *data) {
+    (void)data;
+    return sizeof(int);
+}
+
 void benchmark_memory() {
     printf("\n=== Memory Usage Benchmark ===\n");
-    printf("Size     | Memory (KB) | Bytes/Node | Efficiency\n");
-    printf("---------|-------------|------------|----------\n");
+    printf("Node layout: %s (%zu bytes/node)\n", RB_NODE_LAYOUT, sizeof(rb_node_t));
+    printf("Size     | Memory (KB) | Bytes/Node | Efficiency | Pool (KB) | Bytes/Node\n");
+    printf("---------|-------------|------------|------------|-----------|-----------\n");
     
     int sizes[] = {100, 500, 1000, 5000, 10000, 50000, 100000};
     int num_sizes = sizeof(sizes) / sizeof(sizes[0]);
     
     for (int s = 0; s < num_sizes; s++) {
-        rb_tree_t *tree = rb_tree_create(int_compare, free);
+        rb_tree_config_t config = {0};
+        config.payload_size = int_payload_size;
+        rb_tree_t *tree = rb_tree_create_ex(int_compare, free, &config);
+        config.alloc_mode = RB_ALLOC_POOL;
+        rb_tree_t *pooled = rb_tree_create_ex(int_compare, free, &config);
         
         /* Populate tree */
         for (int i = 0; i < sizes[s]; i++) {
             int *value = create_int(i);
             rb_insert(tree, value);
+            rb_insert(pooled, create_int(i));
         }
         
         size_t memory_usage = rb_memory_usage(tree);
         double memory_kb = (double)memory_usage / 1024.0;
         double bytes_per_node = (double)memory_usage / sizes[s];
         double efficiency = rb_memory_efficiency(tree);
+        size_t pool_usage = rb_memory_usage(pooled);
         
-        printf("%8d | %11.2f | %10.1f | %8.1f%%\n",
-               sizes[s], memory_kb, bytes_per_node, efficiency);
+        printf("%8d | %11.2f | %10.1f | %9.1f%% | %9.2f | %10.1f\n",
+               sizes[s], memory_kb, bytes_per_node, efficiency,
+               (double)pool_usage / 1024.0, (double)pool_usage / sizes[s]);
         
         rb_tree_destroy(tree);
+        rb_tree_destroy(pooled);
     }
 }
 
@@ -282,12 +317,65 @@ void benchmark_height_analysis() {
 }
 
 /* Iterator performance benchmark */
+/* The previous rb_iterator, kept here as the baseline: a heap-allocated
+ * stack of ancestors (64 slots, grown with realloc) */
+typedef struct {
+    rb_tree_t *tree;
+    rb_node_t **stack;
+    int stack_size;
+    int stack_capacity;
+    rb_node_t *current;
+} stack_iterator_t;
+
+static void stack_iterator_push_left(stack_iterator_t *iter) {
+    while (iter->current != iter->tree->nil) {
+        if (iter->stack_size >= iter->stack_capacity) {
+            iter->stack_capacity *= 2;
+            iter->stack = realloc(iter->stack, sizeof(rb_node_t *) * iter->stack_capacity);
+        }
+        iter->stack[iter->stack_size++] = iter->current;
+        iter->current = iter->current->left;
+    }
+}
+
+static void *stack_iterator_first(stack_iterator_t *iter, rb_tree_t *tree) {
+    iter->tree = tree;
+    iter->stack_capacity = 64;
+    iter->stack = malloc(sizeof(rb_node_t *) * iter->stack_capacity);
+    iter->stack_size = 0;
+    iter->current = tree->root;
+    stack_iterator_push_left(iter);
+    if (iter->stack_size == 0) {
+        return NULL;
+    }
+    iter->current = iter->stack[--iter->stack_size];
+    return iter->current->data;
+}
+
+static void *stack_iterator_next(stack_iterator_t *iter) {
+    if (iter->current == iter->tree->nil) {
+        return NULL;
+    }
+    if (iter->current->right != iter->tree->nil) {
+        iter->current = iter->current->right;
+        stack_iterator_push_left(iter);
+        iter->current = iter->stack[--iter->stack_size];
+        return iter->current->data;
+    }
+    if (iter->stack_size > 0) {
+        iter->current = iter->stack[--iter->stack_size];
+        return iter->current->data;
+    }
+    iter->current = iter->tree->nil;
+    return NULL;
+}
+
 void benchmark_iterator() {
-    printf("\n=== Iterator Performance ===\n");
-    printf("Size     | Time (s) | Items/sec\n");
-    printf("---------|----------|----------\n");
+    printf("\n=== Iterator Performance (10M items per column) ===\n");
+    printf("Size     | Full: stack (s) | Full: parent (s) | Reverse (s) | 10-item: stack (s) | 10-item: parent (s) | Speedup\n");
+    printf("---------|-----------------|------------------|-------------|--------------------|---------------------|--------\n");
     
-    int sizes[] = {1000, 5000, 10000, 50000, 100000};
+    int sizes[] = {1000, 10000, 100000, 1000000};
     int num_sizes = sizeof(sizes) / sizeof(sizes[0]);
     
     for (int s = 0; s < num_sizes; s++) {
@@ -299,26 +387,66 @@ void benchmark_iterator() {
             rb_insert(tree, value);
         }
         
+        /* Enough passes that small trees run for a measurable time */
+        int passes = 10000000 / sizes[s];
+        int short_scans = 1000000;
+        int counts[5] = {0};
+        double times[5];
         timer_t timer;
-        timer_start(&timer);
         
-        /* Iterate through entire tree */
-        rb_iterator_t *iter = rb_iterator_create(tree);
-        void *data = rb_iterator_first(iter);
-        int count = 0;
-        
-        while (data) {
-            count++;
-            data = rb_iterator_next(iter);
+        for (int mode = 0; mode < 5; mode++) {
+            timer_start(&timer);
+            if (mode == 0) {
+                for (int p = 0; p < passes; p++) {
+                    stack_iterator_t iter;
+                    for (void *data = stack_iterator_first(&iter, tree); data;
+                         data = stack_iterator_next(&iter)) {
+                        counts[mode]++;
+                    }
+                    free(iter.stack);
+                }
+            } else if (mode == 1 || mode == 2) {
+                /* Stack-allocated iterator, forward then backward */
+                for (int p = 0; p < passes; p++) {
+                    rb_iterator_t iter;
+                    rb_iterator_init(&iter, tree);
+                    void *data = (mode == 1) ? rb_iterator_first(&iter) : rb_iterator_last(&iter);
+                    while (data) {
+                        counts[mode]++;
+                        data = (mode == 1) ? rb_iterator_next(&iter) : rb_iterator_prev(&iter);
+                    }
+                }
+            } else if (mode == 3) {
+                /* Short scans, where setup cost dominates */
+                for (int p = 0; p < short_scans; p++) {
+                    stack_iterator_t iter;
+                    void *data = stack_iterator_first(&iter, tree);
+                    for (int i = 0; i < 10 && data; i++) {
+                        counts[mode]++;
+                        data = stack_iterator_next(&iter);
+                    }
+                    free(iter.stack);
+                }
+            } else {
+                for (int p = 0; p < short_scans; p++) {
+                    rb_iterator_t iter;
+                    rb_iterator_init(&iter, tree);
+                    void *data = rb_iterator_first(&iter);
+                    for (int i = 0; i < 10 && data; i++) {
+                        counts[mode]++;
+                        data = rb_iterator_next(&iter);
+                    }
+                }
+            }
+            timer_stop(&timer);
+            times[mode] = timer.elapsed;
         }
         
-        rb_iterator_destroy(iter);
-        timer_stop(&timer);
-        
-        double items_per_sec = count / timer.elapsed;
-        
-        printf("%8d | %8.4f | %9.0f\n",
-               sizes[s], timer.elapsed, items_per_sec);
+        if (counts[1] != counts[0] || counts[2] != counts[0] || counts[4] != counts[3]) {
+            printf("Iterator count mismatch!\n");
+        }
+        printf("%8d | %15.4f | %16.4f | %11.4f | %18.4f | %19.4f | %6.2fx\n",
+               sizes[s], times[0], times[1], times[2], times[3], times[4], times[3] / times[4]);
         
         rb_tree_destroy(tree);
     }
@@ -384,7 +512,1258 @@ void stress_test() {
     rb_tree_destroy(tree);
 }
 
-int main() {
+/* Node allocator comparison on the stress test's 50/20/30 operation mix */
+static double run_allocator_workload(rb_tree_t *tree, const int *values, const int *ops, int num_ops) {
+    timer_t timer;
+    timer_start(&timer);
+    
+    for (int i = 0; i < num_ops; i++) {
+        if (ops[i] < 5) {
+            rb_insert(tree, (void *)&values[i]);
+        } else if (ops[i] < 7) {
+            rb_delete(tree, &values[i]);
+        } else {
+            rb_search(tree, &values[i]);
+        }
+    }
+    
+    timer_stop(&timer);
+    return timer.elapsed;
+}
+
+void benchmark_allocator() {
+    printf("\n=== Node Allocator Benchmark (50/20/30 mix) ===\n");
+    printf("Ops      | malloc (s) | pool (s) | pool+reserve (s) | Speedup\n");
+    printf("---------|------------|----------|------------------|--------\n");
+    
+    int sizes[] = {10000, 100000, 1000000};
+    int num_sizes = sizeof(sizes) / sizeof(sizes[0]);
+    
+    for (int s = 0; s < num_sizes; s++) {
+        int num_ops = sizes[s];
+        int *values = malloc(sizeof(int) * num_ops);
+        int *ops = malloc(sizeof(int) * num_ops);
+        
+        /* Payloads live in one array so only node allocation differs */
+        for (int i = 0; i < num_ops; i++) {
+            ops[i] = rand() % 10;
+            values[i] = rand() % (num_ops / 2);
+        }
+        
+        rb_tree_config_t config = {0};
+        config.alloc_mode = RB_ALLOC_POOL;
+        
+        rb_tree_t *tree = rb_tree_create(int_compare, NULL);
+        double malloc_time = run_allocator_workload(tree, values, ops, num_ops);
+        rb_tree_destroy(tree);
+        
+        tree = rb_tree_create_ex(int_compare, NULL, &config);
+        double pool_time = run_allocator_workload(tree, values, ops, num_ops);
+        rb_tree_destroy(tree);
+        
+        tree = rb_tree_create_ex(int_compare, NULL, &config);
+        rb_tree_reserve(tree, num_ops / 2);
+        double reserve_time = run_allocator_workload(tree, values, ops, num_ops);
+        rb_tree_destroy(tree);
+        
+        printf("%8d | %10.4f | %8.4f | %16.4f | %6.2fx\n",
+               num_ops, malloc_time, pool_time, reserve_time,
+               pool_time > 0 ? malloc_time / pool_time : 0.0);
+        
+        free(values);
+        free(ops);
+    }
+}
+
+/* Inline int64 keys versus the generic callback path */
+void benchmark_keyed_search() {
+    printf("\n=== Inline Key Search Benchmark ===\n");
+    printf("Size     | Generic (s) | Inline (s) | Speedup\n");
+    printf("---------|-------------|------------|--------\n");
+    
+    int sizes[] = {1000, 10000, 100000, 1000000};
+    int num_sizes = sizeof(sizes) / sizeof(sizes[0]);
+    const int num_searches = 1000000;
+    
+    for (int s = 0; s < num_sizes; s++) {
+        rb_tree_t *generic = rb_tree_create(int_compare, free);
+        rb_tree_t *keyed = rb_tree_create_keyed(RB_KEY_INT64, 0, free);
+        
+        for (int i = 0; i < sizes[s]; i++) {
+            int v = rand() % (sizes[s] * 2);
+            int *value = create_int(v);
+            if (rb_insert(generic, value) != RB_OK) {
+                free(value);
+            }
+            int64_t key = v;
+            value = create_int(v);
+            if (rb_insert_key(keyed, &key, value) != RB_OK) {
+                free(value);
+            }
+        }
+        
+        int *int_keys = malloc(sizeof(int) * num_searches);
+        int64_t *i64_keys = malloc(sizeof(int64_t) * num_searches);
+        for (int i = 0; i < num_searches; i++) {
+            int_keys[i] = rand() % (sizes[s] * 2);
+            i64_keys[i] = int_keys[i];
+        }
+        
+        timer_t timer;
+        int hits = 0;
+        
+        timer_start(&timer);
+        for (int i = 0; i < num_searches; i++) {
+            if (rb_search(generic, &int_keys[i])) hits++;
+        }
+        timer_stop(&timer);
+        double generic_time = timer.elapsed;
+        
+        timer_start(&timer);
+        for (int i = 0; i < num_searches; i++) {
+            if (rb_search(keyed, &i64_keys[i])) hits--;
+        }
+        timer_stop(&timer);
+        double keyed_time = timer.elapsed;
+        
+        printf("%8d | %11.4f | %10.4f | %6.2fx%s\n",
+               sizes[s], generic_time, keyed_time,
+               keyed_time > 0 ? generic_time / keyed_time : 0.0,
+               hits == 0 ? "" : "  (hit mismatch!)");
+        
+        free(int_keys);
+        free(i64_keys);
+        rb_tree_destroy(generic);
+        rb_tree_destroy(keyed);
+    }
+}
+
+/* Index-linked array storage versus pointer-linked nodes */
+void benchmark_index_tree() {
+    printf("\n=== Index-Linked Tree Benchmark ===\n");
+    printf("Size     | Pointer ins (s) | Index ins (s) | Pointer find (s) | Index find (s) | Node bytes\n");
+    printf("---------|-----------------|---------------|------------------|----------------|-----------\n");
+    
+    int sizes[] = {10000, 100000, 1000000};
+    int num_sizes = sizeof(sizes) / sizeof(sizes[0]);
+    
+    for (int s = 0; s < num_sizes; s++) {
+        int *values = malloc(sizeof(int) * sizes[s]);
+        for (int i = 0; i < sizes[s]; i++) {
+            values[i] = rand();
+        }
+        
+        rb_tree_t *tree = rb_tree_create(int_compare, NULL);
+        rb_index_tree_t *itree = rb_index_tree_create(int_compare, NULL);
+        timer_t timer;
+        
+        timer_start(&timer);
+        for (int i = 0; i < sizes[s]; i++) {
+            rb_insert(tree, &values[i]);
+        }
+        timer_stop(&timer);
+        double pointer_insert = timer.elapsed;
+        
+        timer_start(&timer);
+        for (int i = 0; i < sizes[s]; i++) {
+            rb_index_insert(itree, &values[i]);
+        }
+        timer_stop(&timer);
+        double index_insert = timer.elapsed;
+        
+        timer_start(&timer);
+        for (int i = 0; i < sizes[s]; i++) {
+            rb_search(tree, &values[rand() % sizes[s]]);
+        }
+        timer_stop(&timer);
+        double pointer_search = timer.elapsed;
+        
+        timer_start(&timer);
+        for (int i = 0; i < sizes[s]; i++) {
+            rb_index_search(itree, &values[rand() % sizes[s]]);
+        }
+        timer_stop(&timer);
+        double index_search = timer.elapsed;
+        
+        printf("%8d | %15.4f | %13.4f | %16.4f | %14.4f | %2zu vs %2zu\n",
+               sizes[s], pointer_insert, index_insert, pointer_search, index_search,
+               sizeof(rb_node_t), sizeof(rb_index_node_t));
+        
+        rb_index_tree_destroy(itree);
+        rb_tree_destroy(tree);
+        free(values);
+    }
+}
+
+/* Teardown cost of large request-scoped trees */
+void benchmark_arena_teardown() {
+    printf("\n=== Tree Teardown Benchmark ===\n");
+    printf("Size     | malloc destroy (s) | arena reset (s)\n");
+    printf("---------|--------------------|----------------\n");
+    
+    int sizes[] = {100000, 1000000, 4000000};
+    int num_sizes = sizeof(sizes) / sizeof(sizes[0]);
+    
+    for (int s = 0; s < num_sizes; s++) {
+        timer_t timer;
+        
+        rb_tree_t *tree = rb_tree_create(int_compare, free);
+        for (int i = 0; i < sizes[s]; i++) {
+            rb_insert(tree, create_int(rand()));
+        }
+        timer_start(&timer);
+        rb_tree_destroy(tree);
+        timer_stop(&timer);
+        double malloc_time = timer.elapsed;
+        
+        rb_arena_t *arena = rb_arena_create(0);
+        rb_tree_config_t config = {0};
+        config.alloc_mode = RB_ALLOC_ARENA;
+        config.arena = arena;
+        tree = rb_tree_create_ex(int_compare, NULL, &config);
+        for (int i = 0; i < sizes[s]; i++) {
+            int *value = rb_arena_alloc(arena, sizeof(int));
+            *value = rand();
+            rb_insert(tree, value);
+        }
+        timer_start(&timer);
+        rb_tree_destroy(tree);
+        rb_arena_reset(arena);
+        timer_stop(&timer);
+        double arena_time = timer.elapsed;
+        rb_arena_destroy(arena);
+        
+        printf("%8d | %18.4f | %15.4f\n", sizes[s], malloc_time, arena_time);
+    }
+}
+
+/* Batched lookup benchmark: independent searches with overlapped misses */
+void benchmark_search_batch() {
+    printf("\n=== Batched Search Benchmark ===\n");
+    printf("Size     | Keys    | rb_search (s) | rb_search_batch (s) | Speedup\n");
+    printf("---------|---------|---------------|---------------------|--------\n");
+    
+    int sizes[] = {100000, 1000000, 4000000};
+    int num_sizes = sizeof(sizes) / sizeof(sizes[0]);
+    const int num_probes = 1000000;
+    int *probes = malloc(sizeof(int) * num_probes);
+    int64_t *probes64 = malloc(sizeof(int64_t) * num_probes);
+    const void **keys = malloc(sizeof(void *) * num_probes);
+    const void **keys64 = malloc(sizeof(void *) * num_probes);
+    void **results = malloc(sizeof(void *) * num_probes);
+    static int payload;
+    
+    for (int s = 0; s < num_sizes; s++) {
+        rb_tree_t *tree = rb_tree_create(int_compare, free);
+        rb_tree_t *keyed = rb_tree_create_keyed(RB_KEY_INT64, 0, NULL);
+        for (int i = 0; i < sizes[s]; i++) {
+            int value = (int)(((int64_t)i * 2654435761LL) % sizes[s]);
+            rb_insert(tree, create_int(value));
+            int64_t key = value;
+            rb_insert_key(keyed, &key, &payload);
+        }
+        
+        for (int i = 0; i < num_probes; i++) {
+            probes[i] = (int)(((int64_t)rand() * 7919 + rand()) % sizes[s]);
+            probes64[i] = probes[i];
+            keys[i] = &probes[i];
+            keys64[i] = &probes64[i];
+        }
+        
+        rb_tree_t *trees[] = {tree, keyed};
+        const void **key_sets[] = {keys, keys64};
+        const char *names[] = {"generic", "int64"};
+        for (int t = 0; t < 2; t++) {
+            timer_t timer;
+            size_t hits = 0;
+            timer_start(&timer);
+            for (int i = 0; i < num_probes; i++) {
+                if (rb_search(trees[t], key_sets[t][i])) hits++;
+            }
+            timer_stop(&timer);
+            double single_time = timer.elapsed;
+            
+            timer_start(&timer);
+            size_t batch_hits = rb_search_batch(trees[t], key_sets[t], num_probes, results);
+            timer_stop(&timer);
+            
+            printf("%8d | %-7s | %13.4f | %19.4f | %6.2fx%s\n", sizes[s], names[t],
+                   single_time, timer.elapsed, single_time / timer.elapsed,
+                   batch_hits == hits ? "" : " (MISMATCH)");
+        }
+        
+        rb_tree_destroy(tree);
+        rb_tree_destroy(keyed);
+    }
+    
+    free(probes);
+    free(probes64);
+    free(keys);
+    free(keys64);
+    free(results);
+}
+
+/* Sorted batch benchmark: finger search against restarting at the root */
+void benchmark_sorted_batch() {
+    printf("\n=== Sorted Batch Benchmark (1M element tree) ===\n");
+    printf("Batch    | rb_search (s) | rb_search_sorted (s) | rb_insert (s) | rb_insert_sorted (s)\n");
+    printf("---------|---------------|----------------------|---------------|---------------------\n");
+    
+    const int tree_size = 1000000;
+    int batches[] = {1000, 10000, 100000, 1000000};
+    int num_batches = sizeof(batches) / sizeof(batches[0]);
+    
+    rb_tree_t *tree = rb_tree_create(int_compare, free);
+    for (int i = 0; i < tree_size; i++) {
+        rb_insert(tree, create_int(i * 2));
+    }
+    
+    for (int b = 0; b < num_batches; b++) {
+        int k = batches[b];
+        int *probes = malloc(sizeof(int) * k);
+        const void **keys = malloc(sizeof(void *) * k);
+        void **items = malloc(sizeof(void *) * k);
+        void **results = malloc(sizeof(void *) * k);
+        
+        /* Evenly spread sorted probes; odd values are new for the inserts */
+        for (int i = 0; i < k; i++) {
+            probes[i] = (int)((int64_t)i * tree_size * 2 / k);
+            keys[i] = &probes[i];
+        }
+        
+        timer_t timer;
+        timer_start(&timer);
+        for (int i = 0; i < k; i++) {
+            results[i] = rb_search(tree, keys[i]);
+        }
+        timer_stop(&timer);
+        double search_time = timer.elapsed;
+        
+        timer_start(&timer);
+        rb_search_sorted(tree, keys, k, results);
+        timer_stop(&timer);
+        double sorted_search_time = timer.elapsed;
+        
+        /* Insert the odd neighbours into the big tree, then take them out */
+        for (int i = 0; i < k; i++) {
+            probes[i]++;
+            items[i] = create_int(probes[i]);
+        }
+        timer_start(&timer);
+        for (int i = 0; i < k; i++) {
+            rb_insert(tree, items[i]);
+        }
+        timer_stop(&timer);
+        double insert_time = timer.elapsed;
+        for (int i = 0; i < k; i++) {
+            rb_delete(tree, &probes[i]);
+        }
+        
+        for (int i = 0; i < k; i++) {
+            items[i] = create_int(probes[i]);
+        }
+        timer_start(&timer);
+        rb_insert_sorted(tree, items, k, NULL);
+        timer_stop(&timer);
+        for (int i = 0; i < k; i++) {
+            rb_delete(tree, &probes[i]);
+        }
+        
+        printf("%8d | %13.4f | %20.4f | %13.4f | %20.4f\n", k, search_time,
+               sorted_search_time, insert_time, timer.elapsed);
+        
+        free(probes);
+        free(keys);
+        free(items);
+        free(results);
+    }
+    
+    rb_tree_destroy(tree);
+}
+
+/* Lookup cache benchmark: Zipf-distributed rb_search traffic */
+static uint64_t int_hash(const void *key) {
+    return (uint64_t)(uint32_t)*(const int *)key * 0x9E3779B97F4A7C15ULL >> 32;
+}
+
+void benchmark_lookup_cache() {
+    printf("\n=== Lookup Cache Benchmark (Zipf s=1, 1M lookups) ===\n");
+    printf("Size     | Slots | No cache (s) | Cached (s) | Speedup | Hit Rate\n");
+    printf("---------|-------|--------------|------------|---------|---------\n");
+    
+    int sizes[] = {100000, 1000000};
+    size_t slot_counts[] = {1024, 4096, 16384};
+    const int num_probes = 1000000;
+    int *probes = malloc(sizeof(int) * num_probes);
+    
+    for (int s = 0; s < 2; s++) {
+        /* Rank r is drawn with probability ~1/r, then scattered over the keys */
+        for (int i = 0; i < num_probes; i++) {
+            double u = (double)rand() / RAND_MAX;
+            int rank = (int)pow((double)sizes[s], u) - 1;
+            probes[i] = (int)(((int64_t)rank * 2654435761LL) % sizes[s]);
+        }
+        
+        rb_tree_t *plain = rb_tree_create(int_compare, free);
+        for (int i = 0; i < sizes[s]; i++) {
+            rb_insert(plain, create_int(i));
+        }
+        timer_t timer;
+        timer_start(&timer);
+        for (int i = 0; i < num_probes; i++) {
+            rb_search(plain, &probes[i]);
+        }
+        timer_stop(&timer);
+        double plain_time = timer.elapsed;
+        rb_tree_destroy(plain);
+        
+        for (int c = 0; c < 3; c++) {
+            rb_tree_config_t config = {0};
+            config.hash = int_hash;
+            config.lookup_cache_slots = slot_counts[c];
+            rb_tree_t *tree = rb_tree_create_ex(int_compare, free, &config);
+            for (int i = 0; i < sizes[s]; i++) {
+                rb_insert(tree, create_int(i));
+            }
+            
+            timer_start(&timer);
+            for (int i = 0; i < num_probes; i++) {
+                rb_search(tree, &probes[i]);
+            }
+            timer_stop(&timer);
+            
+            rb_tree_stats_t stats = rb_get_statistics(tree);
+            printf("%8d | %5zu | %12.4f | %10.4f | %6.2fx | %7.1f%%\n", sizes[s], slot_counts[c],
+                   plain_time, timer.elapsed, plain_time / timer.elapsed,
+                   100.0 * stats.cache_hits / (stats.cache_hits + stats.cache_misses));
+            rb_tree_destroy(tree);
+        }
+    }
+    
+    free(probes);
+}
+
+/* Bloom filter benchmark: 50% and 0% hit rates, as in benchmark_search */
+void benchmark_bloom_filter() {
+    printf("\n=== Bloom Filter Benchmark (1M lookups) ===\n");
+    printf("Size     | Hit Rate | No filter (s) | Filter (s) | Speedup | FP Rate | Filter bytes\n");
+    printf("---------|----------|---------------|------------|---------|---------|-------------\n");
+    
+    int sizes[] = {100000, 1000000};
+    int hit_percents[] = {50, 0};
+    const int num_probes = 1000000;
+    int *probes = malloc(sizeof(int) * num_probes);
+    
+    for (int s = 0; s < 2; s++) {
+        rb_tree_config_t config = {0};
+        config.hash = int_hash;
+        config.filter_capacity = sizes[s];
+        rb_tree_t *plain = rb_tree_create(int_compare, free);
+        rb_tree_t *filtered = rb_tree_create_ex(int_compare, free, &config);
+        
+        /* Even keys are present */
+        for (int i = 0; i < sizes[s]; i++) {
+            int key = (int)(((int64_t)i * 2654435761LL) % sizes[s]) * 2;
+            rb_insert(plain, create_int(key));
+            rb_insert(filtered, create_int(key));
+        }
+        
+        for (int h = 0; h < 2; h++) {
+            for (int i = 0; i < num_probes; i++) {
+                int key = rand() % sizes[s];
+                probes[i] = (rand() % 100 < hit_percents[h]) ? key * 2 : key * 2 + 1;
+            }
+            
+            timer_t timer;
+            timer_start(&timer);
+            for (int i = 0; i < num_probes; i++) {
+                rb_search(plain, &probes[i]);
+            }
+            timer_stop(&timer);
+            double plain_time = timer.elapsed;
+            
+            filtered->filter_rejects = 0;
+            filtered->filter_false_positives = 0;
+            timer_start(&timer);
+            for (int i = 0; i < num_probes; i++) {
+                rb_search(filtered, &probes[i]);
+            }
+            timer_stop(&timer);
+            
+            rb_tree_stats_t stats = rb_get_statistics(filtered);
+            printf("%8d | %7d%% | %13.4f | %10.4f | %6.2fx | %6.2f%% | %12zu\n",
+                   sizes[s], hit_percents[h], plain_time, timer.elapsed,
+                   plain_time / timer.elapsed, 100.0 * stats.filter_fp_rate, stats.filter_bytes);
+        }
+        
+        rb_tree_destroy(plain);
+        rb_tree_destroy(filtered);
+    }
+    
+    free(probes);
+}
+
+/* Bound query benchmark: rb_lower_bound against the insert-dummy /
+ * rb_successor / delete workaround */
+void benchmark_bound_queries() {
+    printf("\n=== Lower Bound Benchmark (200K queries, even keys) ===\n");
+    printf("Size     | Dummy insert (s) | rb_lower_bound (s) | Speedup\n");
+    printf("---------|------------------|--------------------|--------\n");
+    
+    int sizes[] = {10000, 100000, 1000000};
+    const int num_probes = 200000;
+    int *probes = malloc(sizeof(int) * num_probes);
+    
+    for (int s = 0; s < 3; s++) {
+        rb_tree_t *tree = rb_tree_create(int_compare, free);
+        for (int i = 0; i < sizes[s]; i++) {
+            rb_insert(tree, create_int((int)(((int64_t)i * 2654435761LL) % sizes[s]) * 2));
+        }
+        for (int i = 0; i < num_probes; i++) {
+            probes[i] = rand() % (sizes[s] * 2);
+        }
+        
+        long dummy_sum = 0;
+        timer_t timer;
+        timer_start(&timer);
+        for (int i = 0; i < num_probes; i++) {
+            int *found = rb_search(tree, &probes[i]);
+            if (!found) {
+                rb_insert(tree, create_int(probes[i]));
+                found = rb_successor(tree, &probes[i]);
+                long value = found ? *found : -1;
+                rb_delete(tree, &probes[i]);
+                dummy_sum += value;
+            } else {
+                dummy_sum += *found;
+            }
+        }
+        timer_stop(&timer);
+        double dummy_time = timer.elapsed;
+        
+        long bound_sum = 0;
+        timer_start(&timer);
+        for (int i = 0; i < num_probes; i++) {
+            int *found = rb_lower_bound(tree, &probes[i]);
+            bound_sum += found ? *found : -1;
+        }
+        timer_stop(&timer);
+        
+        if (dummy_sum != bound_sum) {
+            printf("Lower bound mismatch!\n");
+        }
+        printf("%8d | %16.4f | %18.4f | %6.2fx\n", sizes[s], dummy_time, timer.elapsed,
+               dummy_time / timer.elapsed);
+        rb_tree_destroy(tree);
+    }
+    
+    free(probes);
+}
+
+/* Hinted insertion benchmark: ascending ingest takes the rightmost append
+ * path, descending ingest still walks the whole left spine; a sorted run
+ * merged into gaps uses the node found by rb_lower_bound_node as its hint */
+static long counted_compares;
+
+static int counting_compare(const void *a, const void *b) {
+    counted_compares++;
+    return int_compare(a, b);
+}
+
+void benchmark_hinted_insert() {
+    printf("\n=== Hinted Insertion Benchmark ===\n");
+    printf("Size     | Workload          | Time (s) | Compares/insert\n");
+    printf("---------|-------------------|----------|----------------\n");
+    
+    int sizes[] = {100000, 1000000};
+    const char *workloads[] = {"Ascending append", "Descending", "Gaps, no hint", "Gaps, hinted"};
+    
+    for (int s = 0; s < 2; s++) {
+        for (int w = 0; w < 4; w++) {
+            rb_tree_t *tree = rb_tree_create_ex(counting_compare, free, NULL);
+            int n = sizes[s];
+            
+            /* The gap workloads fill odd keys in between existing even keys */
+            if (w >= 2) {
+                for (int i = 0; i < n; i++) {
+                    rb_insert(tree, create_int(i * 2));
+                }
+            }
+            counted_compares = 0;
+            
+            timer_t timer;
+            rb_node_t *hint = NULL;
+            timer_start(&timer);
+            for (int i = 0; i < n; i++) {
+                switch (w) {
+                    case 0:
+                        rb_insert(tree, create_int(i));
+                        break;
+                    case 1:
+                        rb_insert(tree, create_int(n - i));
+                        break;
+                    case 2:
+                        rb_insert(tree, create_int(i * 2 + 1));
+                        break;
+                    default:
+                        /* The upper neighbour of each gap is the next even
+                         * key: step to it instead of searching */
+                        if (i == 0) {
+                            int first = 2;
+                            hint = rb_lower_bound_node(tree, &first);
+                        }
+                        rb_insert_hint(tree, hint, create_int(i * 2 + 1));
+                        hint = rb_next_node(tree, hint);
+                        break;
+                }
+            }
+            timer_stop(&timer);
+            
+            printf("%8d | %-17s | %8.4f | %15.2f\n", n, workloads[w], timer.elapsed,
+                   (double)counted_compares / n);
+            rb_tree_destroy(tree);
+        }
+    }
+}
+
+/* Duplicate-heavy ingest: allocate-then-insert (freeing on RB_DUPLICATE, as
+ * stress_test does) against rb_emplace, which allocates only on a miss */
+static void *construct_int(const void *key, void *context) {
+    (*(int *)context)++;
+    return create_int(*(const int *)key);
+}
+
+static double run_ingest(bool emplace, const int *keys, int count, int *mallocs) {
+    rb_tree_t *tree = rb_tree_create(int_compare, free);
+    timer_t timer;
+    *mallocs = 0;
+    
+    timer_start(&timer);
+    for (int i = 0; i < count; i++) {
+        if (emplace) {
+            rb_emplace(tree, &keys[i], construct_int, mallocs, NULL);
+        } else {
+            int *data = create_int(keys[i]);
+            (*mallocs)++;
+            if (rb_insert(tree, data) == RB_DUPLICATE) {
+                free(data);
+            }
+        }
+    }
+    timer_stop(&timer);
+    
+    rb_tree_destroy(tree);
+    return timer.elapsed;
+}
+
+void benchmark_emplace() {
+    printf("\n=== Emplace Benchmark (1M inserts, best of 2) ===\n");
+    printf("Distinct | Insert+free (s) | Mallocs  | rb_emplace (s) | Mallocs  | Speedup\n");
+    printf("---------|-----------------|----------|----------------|----------|--------\n");
+    
+    int distinct[] = {10000, 100000, 1000000};
+    const int num_ops = 1000000;
+    int *keys = malloc(sizeof(int) * num_ops);
+    
+    for (int d = 0; d < 3; d++) {
+        for (int i = 0; i < num_ops; i++) {
+            keys[i] = rand() % distinct[d];
+        }
+        
+        /* Alternate the order so neither side always runs on a fresh heap */
+        int baseline_mallocs, emplace_mallocs;
+        double baseline_time = run_ingest(false, keys, num_ops, &baseline_mallocs);
+        double emplace_time = run_ingest(true, keys, num_ops, &emplace_mallocs);
+        double t = run_ingest(true, keys, num_ops, &emplace_mallocs);
+        emplace_time = (t < emplace_time) ? t : emplace_time;
+        t = run_ingest(false, keys, num_ops, &baseline_mallocs);
+        baseline_time = (t < baseline_time) ? t : baseline_time;
+        
+        printf("%8d | %15.4f | %8d | %14.4f | %8d | %6.2fx\n", distinct[d], baseline_time,
+               baseline_mallocs, emplace_time, emplace_mallocs, baseline_time / emplace_time);
+    }
+    
+    free(keys);
+}
+
+/* Moving elements between trees: deep copy + insert + delete against
+ * rb_extract + rb_insert_node, which reuses the node and the payload */
+void benchmark_transfer() {
+    printf("\n=== Transfer Benchmark (move every element to a second tree) ===\n");
+    printf("Size     | Copy+delete (s) | Extract+relink (s) | Speedup\n");
+    printf("---------|-----------------|--------------------|--------\n");
+    
+    int sizes[] = {10000, 100000, 1000000};
+    
+    for (int s = 0; s < 3; s++) {
+        int *order = malloc(sizeof(int) * sizes[s]);
+        for (int i = 0; i < sizes[s]; i++) {
+            order[i] = (int)(((int64_t)i * 2654435761LL) % sizes[s]);
+        }
+        
+        double times[2];
+        for (int mode = 0; mode < 2; mode++) {
+            rb_tree_t *from = rb_tree_create(int_compare, free);
+            rb_tree_t *to = rb_tree_create(int_compare, free);
+            for (int i = 0; i < sizes[s]; i++) {
+                rb_insert(from, create_int(i));
+            }
+            
+            timer_t timer;
+            timer_start(&timer);
+            for (int i = 0; i < sizes[s]; i++) {
+                if (mode == 0) {
+                    int *copy = create_int(*(int *)rb_search(from, &order[i]));
+                    rb_insert(to, copy);
+                    rb_delete(from, &order[i]);
+                } else {
+                    rb_node_t *node;
+                    rb_extract(from, &order[i], &node);
+                    rb_insert_node(to, node);
+                }
+            }
+            timer_stop(&timer);
+            times[mode] = timer.elapsed;
+            
+            rb_tree_destroy(from);
+            rb_tree_destroy(to);
+        }
+        
+        printf("%8d | %15.4f | %18.4f | %6.2fx\n", sizes[s], times[0], times[1],
+               times[0] / times[1]);
+        free(order);
+    }
+}
+
+/* Priority queue benchmark: draining a tree from both ends with rb_min/rb_max
+ * + rb_delete (a key search per removal) against rb_pop_min/rb_pop_max */
+void benchmark_priority_queue() {
+    printf("\n=== Priority Queue Benchmark (drain from both ends) ===\n");
+    printf("Size     | min/max+rb_delete (s) | rb_pop_min/max (s) | Speedup\n");
+    printf("---------|-----------------------|--------------------|--------\n");
+    
+    int sizes[] = {1000, 100000, 1000000};
+    
+    for (int s = 0; s < 3; s++) {
+        double times[2];
+        for (int mode = 0; mode < 2; mode++) {
+            rb_tree_t *tree = rb_tree_create(int_compare, free);
+            for (int i = 0; i < sizes[s]; i++) {
+                rb_insert(tree, create_int((int)(((int64_t)i * 2654435761LL) % sizes[s])));
+            }
+            
+            timer_t timer;
+            timer_start(&timer);
+            for (int i = 0; !rb_is_empty(tree); i++) {
+                if (mode == 0) {
+                    int key = *(int *)((i & 1) ? rb_max(tree) : rb_min(tree));
+                    rb_delete(tree, &key);
+                } else {
+                    free((i & 1) ? rb_pop_max(tree) : rb_pop_min(tree));
+                }
+            }
+            timer_stop(&timer);
+            times[mode] = timer.elapsed;
+            rb_tree_destroy(tree);
+        }
+        
+        printf("%8d | %21.4f | %18.4f | %6.2fx\n", sizes[s], times[0], times[1],
+               times[0] / times[1]);
+    }
+}
+
+/* Frozen snapshot benchmark: live rb_search against the Eytzinger layout */
+typedef struct {
+    int items[100];
+    int count;
+} page_t;
+
+static void collect_page(void *data, void *context) {
+    page_t *page = context;
+    if (page->count < 100) {
+        page->items[page->count++] = *(int *)data;
+    }
+}
+
+void benchmark_range_pages() {
+    printf("\n=== Range Paging Benchmark (1M elements, pages of 100) ===\n");
+    printf("Range    | rb_walk_range (s) | rb_range resume (s) | Speedup\n");
+    printf("---------|-------------------|---------------------|--------\n");
+    
+    const int size = 1000000;
+    rb_tree_t *tree = rb_tree_create(int_compare, free);
+    for (int i = 0; i < size; i++) {
+        rb_insert(tree, create_int((int)(((int64_t)i * 2654435761LL) % size)));
+    }
+    
+    int widths[] = {1000, 10000, 100000};
+    
+    for (int w = 0; w < 3; w++) {
+        int lo = size / 2, hi = lo + widths[w] - 1;
+        long walk_sum = 0, range_sum = 0;
+        
+        /* The walk can't stop early: each page walks from the token to hi */
+        timer_t timer;
+        timer_start(&timer);
+        int start = lo;
+        for (;;) {
+            page_t page = {.count = 0};
+            rb_walk_range(tree, &start, &hi, collect_page, &page);
+            if (page.count == 0) {
+                break;
+            }
+            walk_sum += page.items[page.count - 1];
+            start = page.items[page.count - 1] + 1;
+        }
+        timer_stop(&timer);
+        double walk_time = timer.elapsed;
+        
+        timer_start(&timer);
+        rb_range_t range;
+        int token = 0;
+        bool resume = false;
+        for (;;) {
+            if (resume) {
+                rb_range_resume(&range, tree, &token, &hi, 0);
+            } else {
+                rb_range_init(&range, tree, &lo, &hi, 0);
+            }
+            page_t page = {.count = 0};
+            int *value;
+            while (page.count < 100 && (value = rb_range_next(&range))) {
+                page.items[page.count++] = *value;
+            }
+            if (page.count == 0) {
+                break;
+            }
+            range_sum += page.items[page.count - 1];
+            token = *(const int *)rb_range_token(&range);
+            resume = true;
+        }
+        timer_stop(&timer);
+        
+        if (walk_sum != range_sum) {
+            printf("Range paging mismatch!\n");
+        }
+        printf("%8d | %17.4f | %19.4f | %6.1fx\n", widths[w], walk_time, timer.elapsed,
+               walk_time / timer.elapsed);
+    }
+    
+    rb_tree_destroy(tree);
+}
+
+/* Builds trees[0] plain and trees[1] with config from the same scrambled
+ * keys 0..size-1. Best of two alternating builds; the survivors serve the
+ * queries. */
+static void build_tree_pair(rb_tree_t *trees[2], double build_times[2],
+                            const rb_tree_config_t *config, int size) {
+    trees[0] = trees[1] = NULL;
+    for (int run = 0; run < 4; run++) {
+        int t = run & 1;
+        if (trees[t]) {
+            rb_tree_destroy(trees[t]);
+        }
+        trees[t] = t ? rb_tree_create_ex(int_compare, free, config)
+                     : rb_tree_create(int_compare, free);
+        timer_t timer;
+        timer_start(&timer);
+        for (int i = 0; i < size; i++) {
+            rb_insert(trees[t], create_int((int)(((int64_t)i * 2654435761LL) % size)));
+        }
+        timer_stop(&timer);
+        if (run < 2 || timer.elapsed < build_times[t]) {
+            build_times[t] = timer.elapsed;
+        }
+    }
+}
+
+void benchmark_order_statistics() {
+    printf("\n=== Order Statistics Benchmark (1M elements, 100 random ranges) ===\n");
+    printf("Width    | Counting walk (s) | Subtree sizes (s) | Speedup\n");
+    printf("---------|-------------------|-------------------|--------\n");
+    
+    const int size = 1000000;
+    const int num_queries = 100;
+    rb_tree_config_t config = {0};
+    config.order_statistics = true;
+    rb_tree_t *trees[2];
+    double build_times[2];
+    build_tree_pair(trees, build_times, &config, size);
+    
+    int widths[] = {100, 10000, 100000};
+    
+    for (int w = 0; w < 3; w++) {
+        int lows[100];
+        for (int i = 0; i < num_queries; i++) {
+            lows[i] = rand() % (size - widths[w]);
+        }
+        
+        double times[2];
+        size_t totals[2] = {0, 0};
+        for (int t = 0; t < 2; t++) {
+            timer_t timer;
+            timer_start(&timer);
+            for (int i = 0; i < num_queries; i++) {
+                int hi = lows[i] + widths[w] - 1;
+                totals[t] += rb_count_range(trees[t], &lows[i], &hi);
+            }
+            timer_stop(&timer);
+            times[t] = timer.elapsed;
+        }
+        
+        if (totals[0] != totals[1]) {
+            printf("Range count mismatch!\n");
+        }
+        printf("%8d | %17.6f | %17.6f | %6.0fx\n", widths[w], times[0], times[1],
+               times[0] / times[1]);
+    }
+    
+    /* The price: one extra word per node and a size update per level */
+    printf("Build 1M: plain %.4f s, with subtree sizes %.4f s (%+.0f%%)\n",
+           build_times[0], build_times[1], (build_times[1] / build_times[0] - 1) * 100);
+    
+    rb_tree_destroy(trees[0]);
+    rb_tree_destroy(trees[1]);
+}
+
+static void sum_value(void *out, const void *data) {
+    *(int64_t *)out = *(const int *)data;
+}
+
+static void sum_combine(void *acc, const void *next) {
+    *(int64_t *)acc += *(const int64_t *)next;
+}
+
+static void sum_visit(void *data, void *context) {
+    *(int64_t *)context += *(int *)data;
+}
+
+void benchmark_aggregates() {
+    printf("\n=== Range Aggregate Benchmark (1M elements, 100 random range sums) ===\n");
+    printf("Width    | rb_walk_range (s) | rb_aggregate_range (s) | Speedup\n");
+    printf("---------|-------------------|------------------------|--------\n");
+    
+    const int size = 1000000;
+    const int num_queries = 100;
+    static const int64_t zero = 0;
+    rb_tree_config_t config = {0};
+    config.augment.size = sizeof(int64_t);
+    config.augment.identity = &zero;
+    config.augment.value = sum_value;
+    config.augment.combine = sum_combine;
+    rb_tree_t *trees[2];
+    double build_times[2];
+    build_tree_pair(trees, build_times, &config, size);
+    
+    int widths[] = {100, 10000, 100000};
+    
+    for (int w = 0; w < 3; w++) {
+        int lows[100];
+        for (int i = 0; i < num_queries; i++) {
+            lows[i] = rand() % (size - widths[w]);
+        }
+        
+        int64_t walk_total = 0, aggregate_total = 0;
+        timer_t timer;
+        timer_start(&timer);
+        for (int i = 0; i < num_queries; i++) {
+            int hi = lows[i] + widths[w] - 1;
+            rb_walk_range(trees[0], &lows[i], &hi, sum_visit, &walk_total);
+        }
+        timer_stop(&timer);
+        double walk_time = timer.elapsed;
+        
+        timer_start(&timer);
+        for (int i = 0; i < num_queries; i++) {
+            int hi = lows[i] + widths[w] - 1;
+            int64_t sum;
+            rb_aggregate_range(trees[1], &lows[i], &hi, &sum);
+            aggregate_total += sum;
+        }
+        timer_stop(&timer);
+        
+        if (walk_total != aggregate_total) {
+            printf("Range sum mismatch!\n");
+        }
+        printf("%8d | %17.6f | %22.6f | %6.0fx\n", widths[w], walk_time, timer.elapsed,
+               walk_time / timer.elapsed);
+    }
+    
+    /* The price: 8 bytes per node and a recombine per level on updates */
+    printf("Build 1M: plain %.4f s, with a sum aggregate %.4f s (%+.0f%%)\n",
+           build_times[0], build_times[1], (build_times[1] / build_times[0] - 1) * 100);
+    
+    rb_tree_destroy(trees[0]);
+    rb_tree_destroy(trees[1]);
+}
+
+void benchmark_frozen(bool large) {
+    printf("\n=== Frozen Snapshot Benchmark (int64 keys) ===\n");
+    printf("Size      | rb_search (ns/op) | rb_frozen_search (ns/op) | Speedup | Freeze (s)\n");
+    printf("----------|-------------------|--------------------------|---------|-----------\n");
+    
+    int sizes[] = {1000, 10000, 100000, 1000000, 10000000, 100000000};
+    int num_sizes = large ? 6 : 4;
+    const int num_probes = 1000000;
+    int64_t *probes = malloc(sizeof(int64_t) * num_probes);
+    static int payload;
+    
+    for (int s = 0; s < num_sizes; s++) {
+        rb_tree_t *tree = rb_tree_create_keyed(RB_KEY_INT64, 0, NULL);
+        for (int64_t i = 0; i < sizes[s]; i++) {
+            int64_t key = (i * 2654435761LL) % sizes[s] * 2;
+            rb_insert_key(tree, &key, &payload);
+        }
+        for (int i = 0; i < num_probes; i++) {
+            probes[i] = ((int64_t)rand() * RAND_MAX + rand()) % ((int64_t)sizes[s] * 2);
+        }
+        
+        timer_t timer;
+        timer_start(&timer);
+        rb_frozen_t *frozen = rb_freeze(tree);
+        timer_stop(&timer);
+        double freeze_time = timer.elapsed;
+        
+        int live_hits = 0;
+        timer_start(&timer);
+        for (int i = 0; i < num_probes; i++) {
+            if (rb_search(tree, &probes[i])) live_hits++;
+        }
+        timer_stop(&timer);
+        double live_time = timer.elapsed;
+        
+        int frozen_hits = 0;
+        timer_start(&timer);
+        for (int i = 0; i < num_probes; i++) {
+            if (rb_frozen_search(frozen, &probes[i])) frozen_hits++;
+        }
+        timer_stop(&timer);
+        
+        printf("%9d | %17.1f | %24.1f | %6.2fx | %9.4f%s\n", sizes[s],
+               live_time * 1e9 / num_probes, timer.elapsed * 1e9 / num_probes,
+               live_time / timer.elapsed, freeze_time,
+               live_hits == frozen_hits ? "" : " (MISMATCH)");
+        
+        rb_frozen_destroy(frozen);
+        rb_tree_destroy(tree);
+    }
+    if (!large) {
+        printf("(run with --large for 10M and 100M element trees)\n");
+    }
+    
+    free(probes);
+}
+
+/* Static B+ tree benchmark: 16-key SIMD nodes against the binary layouts */
+void benchmark_stree(bool large) {
+    printf("\n=== Static B+ Tree Benchmark (int64 keys, ns/op) ===\n");
+#if defined(__AVX2__)
+    printf("Node search: AVX2\n");
+#elif defined(__SSE4_2__)
+    printf("Node search: SSE4.2\n");
+#else
+    printf("Node search: scalar (build with -march=native for SIMD)\n");
+#endif
+    printf("Size      | rb_search | Eytzinger | S-tree | Range count (ns/op)\n");
+    printf("----------|-----------|-----------|--------|--------------------\n");
+    
+    int sizes[] = {1000, 10000, 100000, 1000000, 10000000};
+    int num_sizes = large ? 5 : 4;
+    const int num_probes = 1000000;
+    int64_t *probes = malloc(sizeof(int64_t) * num_probes);
+    static int payload;
+    
+    for (int s = 0; s < num_sizes; s++) {
+        rb_tree_t *tree = rb_tree_create_keyed(RB_KEY_INT64, 0, NULL);
+        for (int64_t i = 0; i < sizes[s]; i++) {
+            int64_t key = (i * 2654435761LL) % sizes[s] * 2;
+            rb_insert_key(tree, &key, &payload);
+        }
+        for (int i = 0; i < num_probes; i++) {
+            probes[i] = ((int64_t)rand() * RAND_MAX + rand()) % ((int64_t)sizes[s] * 2);
+        }
+        rb_frozen_t *frozen = rb_freeze(tree);
+        rb_stree_t *stree = rb_stree_build(tree);
+        
+        timer_t timer;
+        double times[4];
+        size_t hits[3] = {0, 0, 0};
+        
+        timer_start(&timer);
+        for (int i = 0; i < num_probes; i++) {
+            if (rb_search(tree, &probes[i])) hits[0]++;
+        }
+        timer_stop(&timer);
+        times[0] = timer.elapsed;
+        
+        timer_start(&timer);
+        for (int i = 0; i < num_probes; i++) {
+            if (rb_frozen_search(frozen, &probes[i])) hits[1]++;
+        }
+        timer_stop(&timer);
+        times[1] = timer.elapsed;
+        
+        timer_start(&timer);
+        for (int i = 0; i < num_probes; i++) {
+            if (rb_stree_search(stree, probes[i])) hits[2]++;
+        }
+        timer_stop(&timer);
+        times[2] = timer.elapsed;
+        
+        size_t counted = 0;
+        timer_start(&timer);
+        for (int i = 0; i < num_probes; i++) {
+            counted += rb_stree_count_range(stree, probes[i], probes[i] + 1000);
+        }
+        timer_stop(&timer);
+        times[3] = timer.elapsed;
+        (void)counted;
+        
+        printf("%9d | %9.1f | %9.1f | %6.1f | %18.1f%s\n", sizes[s],
+               times[0] * 1e9 / num_probes, times[1] * 1e9 / num_probes,
+               times[2] * 1e9 / num_probes, times[3] * 1e9 / num_probes,
+               hits[0] == hits[1] && hits[1] == hits[2] ? "" : " (MISMATCH)");
+        
+        rb_stree_destroy(stree);
+        rb_frozen_destroy(frozen);
+        rb_tree_destroy(tree);
+    }
+    
+    free(probes);
+}
+
+/* String key benchmark: strcmp callback against cached 8-byte prefixes */
+static int string_compare(const void *a, const void *b) {
+    return strcmp((const char *)a, (const char *)b);
+}
+
+void benchmark_string_keys() {
+    printf("\n=== String Key Benchmark (200K keys, 1M lookups) ===\n");
+    printf("Key set   | Example                        | strcmp (s) | Prefix (s) | Speedup\n");
+    printf("----------|--------------------------------|------------|------------|--------\n");
+    
+    const int n = 200000;
+    const int num_probes = 1000000;
+    const char *formats[] = {
+        "https://www.example.com/%s/item/%d",   /* Shared scheme and host */
+        "/srv/data/%s/%d/index.html",           /* Shared directory prefix */
+        "%s-%d.cdn.example.net/static/app.js"   /* Prefix varies early */
+    };
+    const char *names[] = {"URLs", "Paths", "Hosts"};
+    const char *segments[] = {"alpha", "beta", "gamma", "delta", "epsilon", "zeta", "eta", "theta"};
+    char **keys = malloc(sizeof(char *) * n);
+    int *probe_index = malloc(sizeof(int) * num_probes);
+    
+    for (int f = 0; f < 3; f++) {
+        for (int i = 0; i < n; i++) {
+            char buffer[128];
+            snprintf(buffer, sizeof(buffer), formats[f], segments[rand() % 8], rand());
+            keys[i] = malloc(strlen(buffer) + 1);
+            strcpy(keys[i], buffer);
+        }
+        for (int i = 0; i < num_probes; i++) {
+            probe_index[i] = rand() % n;
+        }
+        
+        rb_tree_t *generic = rb_tree_create(string_compare, NULL);
+        rb_tree_t *keyed = rb_tree_create_keyed(RB_KEY_STRING, 0, NULL);
+        for (int i = 0; i < n; i++) {
+            rb_insert(generic, keys[i]);
+            rb_insert_key(keyed, keys[i], keys[i]);
+        }
+        
+        timer_t timer;
+        int hits = 0;
+        timer_start(&timer);
+        for (int i = 0; i < num_probes; i++) {
+            if (rb_search(generic, keys[probe_index[i]])) hits++;
+        }
+        timer_stop(&timer);
+        double generic_time = timer.elapsed;
+        
+        timer_start(&timer);
+        for (int i = 0; i < num_probes; i++) {
+            if (rb_search(keyed, keys[probe_index[i]])) hits--;
+        }
+        timer_stop(&timer);
+        
+        printf("%-9s | %-30.30s | %10.4f | %10.4f | %6.2fx%s\n", names[f], keys[0],
+               generic_time, timer.elapsed, generic_time / timer.elapsed,
+               hits == 0 ? "" : " (MISMATCH)");
+        
+        rb_tree_destroy(generic);
+        rb_tree_destroy(keyed);
+        for (int i = 0; i < n; i++) {
+            free(keys[i]);
+        }
+    }
+    
+    free(keys);
+    free(probe_index);
+}
+
+/* Huge page benchmark: random lookups in trees far larger than the TLB reach */
+static double time_random_lookups(rb_alloc_mode_t mode, int size, const int64_t *probes,
+                                  int num_probes, size_t *hugepage_bytes) {
+    static int payload;
+    rb_tree_config_t config = {0};
+    config.alloc_mode = mode;
+    config.key_type = RB_KEY_INT64;
+    rb_tree_t *tree = rb_tree_create_ex(NULL, NULL, &config);
+    
+    for (int64_t i = 0; i < size; i++) {
+        int64_t key = (i * 2654435761LL) % size;  /* Scatter key order over memory */
+        rb_insert_key(tree, &key, &payload);
+    }
+    *hugepage_bytes = rb_tree_hugepage_bytes(tree);
+    
+    timer_t timer;
+    int hits = 0;
+    timer_start(&timer);
+    for (int i = 0; i < num_probes; i++) {
+        if (rb_search(tree, &probes[i])) hits++;
+    }
+    timer_stop(&timer);
+    
+    rb_tree_destroy(tree);
+    return hits == num_probes ? timer.elapsed : -1.0;
+}
+
+void benchmark_hugepages(bool large) {
+    printf("\n=== Huge Page Node Storage Benchmark ===\n");
+    printf("Size     | Pool (ns/op) | Huge pages (ns/op) | Speedup | Huge page MB\n");
+    printf("---------|--------------|--------------------|---------|-------------\n");
+    
+    int sizes[] = {1000000, 10000000, 20000000};
+    int num_sizes = large ? 3 : 1;
+    const int num_probes = 2000000;
+    int64_t *probes = malloc(sizeof(int64_t) * num_probes);
+    
+    for (int s = 0; s < num_sizes; s++) {
+        for (int i = 0; i < num_probes; i++) {
+            probes[i] = ((int64_t)rand() * RAND_MAX + rand()) % sizes[s];
+        }
+        
+        size_t pool_huge, huge_bytes;
+        double pool_time = time_random_lookups(RB_ALLOC_POOL, sizes[s], probes, num_probes,
+                                               &pool_huge);
+        double huge_time = time_random_lookups(RB_ALLOC_HUGEPAGE, sizes[s], probes, num_probes,
+                                               &huge_bytes);
+        
+        printf("%8d | %12.1f | %18.1f | %6.2fx | %11.1f\n", sizes[s],
+               pool_time * 1e9 / num_probes, huge_time * 1e9 / num_probes,
+               pool_time / huge_time, huge_bytes / (1024.0 * 1024.0));
+    }
+    if (!large) {
+        printf("(run with --large for 10M and 20M element trees)\n");
+    }
+    
+    free(probes);
+}
+
+int main(int argc, char **argv) {
+    bool large = argc > 1 && strcmp(argv[1], "--large") == 0;
+    
     printf("Red-Black Tree Performance Benchmark\n");
     printf("====================================\n");
     
@@ -397,6 +1776,26 @@ int main() {
     benchmark_height_analysis();
     benchmark_iterator();
     stress_test();
+    benchmark_allocator();
+    benchmark_keyed_search();
+    benchmark_index_tree();
+    benchmark_arena_teardown();
+    benchmark_search_batch();
+    benchmark_sorted_batch();
+    benchmark_lookup_cache();
+    benchmark_frozen(large);
+    benchmark_stree(large);
+    benchmark_string_keys();
+    benchmark_bloom_filter();
+    benchmark_bound_queries();
+    benchmark_hinted_insert();
+    benchmark_emplace();
+    benchmark_transfer();
+    benchmark_priority_queue();
+    benchmark_range_pages();
+    benchmark_order_statistics();
+    benchmark_aggregates();
+    benchmark_hugepages(large);
     
     printf("\nBenchmark completed successfully!\n");
     return 0;
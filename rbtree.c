@@ -1,20 +1,144 @@
+#define _DEFAULT_SOURCE /* MAP_ANONYMOUS and madvise under -std=c99 */
 #include "rbtree.h"
+#include "rbtree_arena.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <assert.h>
 
-static rb_node_t *rb_node_create(rb_tree_t *tree, void *data);
+/* Charge what the allocator really handed out: rounded block size plus,
+ * for glibc, the size word in front of every chunk */
+#if defined(__GLIBC__)
+#include <malloc.h>
+#define RB_MALLOC_CHARGE(ptr, bytes) (malloc_usable_size(ptr) + sizeof(size_t))
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#define RB_MALLOC_CHARGE(ptr, bytes) malloc_size(ptr)
+#else
+#define RB_MALLOC_CHARGE(ptr, bytes) (bytes)
+#endif
+
+/* Huge page chunks need anonymous mmap; elsewhere they fall back to malloc */
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#if defined(MAP_ANONYMOUS)
+#define RB_HAVE_MMAP 1
+#endif
+#endif
+
+#define RB_HUGEPAGE_SIZE ((size_t)2 * 1024 * 1024)
+
+#define RB_POOL_DEFAULT_CHUNK_NODES 1024
+
+/* Inline keys are stored directly after the node header */
+#define RB_INLINE_KEY(node) ((void *)((char *)(node) + sizeof(rb_node_t)))
+
+/* String keys keep the first 8 bytes as a big-endian integer next to the
+ * caller's string, so most comparisons never leave the node */
+typedef struct {
+    uint64_t prefix;
+    const char *str;
+} rb_string_key_t;
+
+#define RB_STRING_KEY(node) ((const rb_string_key_t *)RB_INLINE_KEY(node))
+
+/* Order-statistic trees keep the subtree size after the inline key; nil
+ * counts as an empty subtree */
+#define RB_SUBTREE_COUNT(tree, node) (*(size_t *)((char *)(node) + (tree)->count_offset))
+
+/* User aggregates follow; nil holds the identity */
+#define RB_AGGREGATE(tree, node) ((void *)((char *)(node) + (tree)->aggregate_offset))
+
+#define RB_AUGMENTED(tree) ((tree)->count_offset || (tree)->aggregate_offset)
+
+/* A node handed out by rb_extract records its tree's layout in its (now
+ * unused) child links; the size, key type and key size fix every field
+ * offset. rb_insert_node refuses nodes whose layout differs, since it
+ * would read and write them past their allocation. */
+#define RB_LAYOUT_SIZE_TAG(tree) ((rb_node_t *)(uintptr_t)(tree)->node_size)
+#define RB_LAYOUT_KEY_TAG(tree) \
+    ((rb_node_t *)(uintptr_t)((tree)->key_size * 16 + (tree)->key_type * 2 + \
+                              ((tree)->count_offset != 0)))
+
+#ifdef RB_COMPACT_NODES
+/* The compact layout must stay at four words (32 bytes on LP64) */
+typedef char rb_compact_node_size_check[(sizeof(rb_node_t) == 4 * sizeof(void *)) ? 1 : -1];
+#endif
+
+/* Slab chunk header; nodes are carved from the memory that follows it */
+struct rb_pool_chunk {
+    struct rb_pool_chunk *next;
+    size_t capacity;
+    size_t mapped;              /* Length of the mmap region, 0 if malloc'd */
+};
+
+/* Round the header up so carved nodes keep malloc's 16-byte alignment */
+#define RB_POOL_CHUNK_HEADER ((sizeof(struct rb_pool_chunk) + 15) & ~(size_t)15)
+
+/* Bloom filter geometry: 128 counters per cache line, about 10 counters
+ * and 6 probes per expected key (roughly 1% false positives at capacity) */
+#define RB_FILTER_BLOCK_BYTES 64
+#define RB_FILTER_BLOCK_COUNTERS (RB_FILTER_BLOCK_BYTES * 2)
+#define RB_FILTER_COUNTERS_PER_KEY 10
+#define RB_FILTER_PROBES 6
+
+/* Lookup cache slot: the hash is kept so that mismatches skip the compare */
+struct rb_cache_entry {
+    uint64_t hash;
+    rb_node_t *node;
+};
+
+/* Arena trees carve nodes exactly like pooled ones, from arena-owned chunks */
+#define RB_USES_POOL(tree) \
+    ((tree)->alloc_mode == RB_ALLOC_POOL || (tree)->alloc_mode == RB_ALLOC_ARENA || \
+     (tree)->alloc_mode == RB_ALLOC_HUGEPAGE)
+
+static void *rb_mem_alloc(rb_tree_t *tree, size_t bytes);
+static void rb_mem_free(rb_tree_t *tree, void *ptr, size_t bytes);
+static struct rb_pool_chunk *rb_chunk_alloc(rb_tree_t *tree, size_t nodes);
+static void rb_chunk_free(rb_tree_t *tree, struct rb_pool_chunk *chunk);
+static void rb_cache_forget(rb_tree_t *tree, rb_node_t *node);
+static void rb_cache_reset(rb_tree_t *tree);
+static bool rb_filter_may_contain(const rb_tree_t *tree, uint64_t hash);
+static void rb_filter_update(rb_tree_t *tree, const rb_node_t *node, int delta);
+static inline uint64_t rb_string_prefix(const char *str);
+static rb_node_t *rb_node_alloc(rb_tree_t *tree);
+static void rb_node_free(rb_tree_t *tree, rb_node_t *node);
+static rb_result_t rb_pool_grow(rb_tree_t *tree, size_t nodes);
+static void rb_pool_release(rb_tree_t *tree);
+static rb_node_t *rb_node_create(rb_tree_t *tree, const void *key, void *data);
 static void rb_node_destroy(rb_tree_t *tree, rb_node_t *node);
 static rb_node_t *rb_tree_minimum_node(rb_tree_t *tree, rb_node_t *node);
 static rb_node_t *rb_tree_maximum_node(rb_tree_t *tree, rb_node_t *node);
 static rb_node_t *rb_tree_successor_node(rb_tree_t *tree, rb_node_t *node);
 static rb_node_t *rb_tree_predecessor_node(rb_tree_t *tree, rb_node_t *node);
+static rb_node_t *rb_bound_node(rb_tree_t *tree, const void *key, bool upward, bool inclusive);
 static rb_node_t *rb_find_node(rb_tree_t *tree, const void *data);
+static rb_node_t *rb_find_slot(rb_tree_t *tree, const void *key, rb_node_t **parent, int *cmp);
+static rb_result_t rb_insert_node_key(rb_tree_t *tree, const void *key, void *data);
+static void *rb_insert_or_get_key(rb_tree_t *tree, const void *key, void *data);
+static rb_result_t rb_upsert_node_key(rb_tree_t *tree, const void *key, void *data, void **replaced);
+static void rb_node_replace_data(rb_tree_t *tree, rb_node_t *node, const void *key, void *data);
+static rb_result_t rb_link_new_node(rb_tree_t *tree, rb_node_t *parent, int cmp,
+                                    const void *key, void *data, rb_node_t **node_out);
+static rb_result_t rb_insert_hinted(rb_tree_t *tree, rb_node_t *hint, const void *key, void *data);
+static void rb_unlink_node(rb_tree_t *tree, rb_node_t *z);
+static void *rb_detach_node(rb_tree_t *tree, rb_node_t *z, rb_node_t **node_out);
+static void rb_link_node(rb_tree_t *tree, rb_node_t *parent, int cmp, rb_node_t *z);
+static rb_node_t *rb_finger_start(rb_tree_t *tree, rb_node_t *finger, const void *key);
 static void rb_left_rotate(rb_tree_t *tree, rb_node_t *x);
 static void rb_right_rotate(rb_tree_t *tree, rb_node_t *y);
 static void rb_insert_fixup(rb_tree_t *tree, rb_node_t *z);
 static void rb_delete_fixup(rb_tree_t *tree, rb_node_t *x);
 static void rb_transplant(rb_tree_t *tree, rb_node_t *u, rb_node_t *v);
+static void rb_augment_update(rb_tree_t *tree, rb_node_t *node);
+static void rb_augment_rotate(rb_tree_t *tree, rb_node_t *old_top, rb_node_t *new_top);
+static void rb_augment_propagate(rb_tree_t *tree, rb_node_t *node);
+static void rb_aggregate_from(rb_tree_t *tree, rb_node_t *node, const void *lo, void *acc);
+static void rb_aggregate_upto(rb_tree_t *tree, rb_node_t *node, const void *hi, void *acc);
 static void rb_inorder_walk_node(rb_tree_t *tree, rb_node_t *node, rb_visit_func_t visit, void *context);
 static void rb_preorder_walk_node(rb_tree_t *tree, rb_node_t *node, rb_visit_func_t visit, void *context);
 static void rb_postorder_walk_node(rb_tree_t *tree, rb_node_t *node, rb_visit_func_t visit, void *context);
@@ -22,35 +146,216 @@ static int rb_height_node(rb_tree_t *tree, rb_node_t *node);
 static bool rb_is_valid_node(rb_tree_t *tree, rb_node_t *node, int *black_height);
 
 rb_tree_t *rb_tree_create(rb_compare_func_t compare_func, rb_free_func_t free_func) {
-    if (!compare_func) {
+    return rb_tree_create_ex(compare_func, free_func, NULL);
+}
+
+rb_tree_t *rb_tree_create_ex(rb_compare_func_t compare_func, rb_free_func_t free_func,
+                             const rb_tree_config_t *config) {
+    rb_tree_config_t defaults = {0};
+    if (!config) {
+        config = &defaults;
+    }
+    
+    if (config->alloc_mode != RB_ALLOC_MALLOC && config->alloc_mode != RB_ALLOC_POOL &&
+        config->alloc_mode != RB_ALLOC_INTRUSIVE && config->alloc_mode != RB_ALLOC_ARENA &&
+        config->alloc_mode != RB_ALLOC_HUGEPAGE) {
         return NULL;
     }
     
-    rb_tree_t *tree = malloc(sizeof(rb_tree_t));
-    if (!tree) {
+    /* Arena trees are torn down without visiting nodes, so they cannot own
+     * individually freed payloads */
+    if (config->alloc_mode == RB_ALLOC_ARENA && (!config->arena || free_func)) {
+        return NULL;
+    }
+    
+    if ((config->lookup_cache_slots || config->filter_capacity) && !config->hash) {
+        return NULL;
+    }
+    
+    size_t key_size = 0;
+    switch (config->key_type) {
+        case RB_KEY_GENERIC:
+            if (!compare_func) {
+                return NULL;
+            }
+            break;
+        case RB_KEY_INT64:
+        case RB_KEY_UINT64:
+        case RB_KEY_DOUBLE:
+            key_size = 8;
+            break;
+        case RB_KEY_BYTES:
+            key_size = config->key_size;
+            if (key_size == 0) {
+                return NULL;
+            }
+            break;
+        case RB_KEY_STRING:
+            key_size = sizeof(rb_string_key_t);
+            break;
+        default:
+            return NULL;
+    }
+    
+    const rb_augment_t *augment = &config->augment;
+    if (augment->size &&
+        (!augment->identity || !augment->value || !augment->combine)) {
         return NULL;
     }
     
-    tree->nil = malloc(sizeof(rb_node_t));
-    if (!tree->nil) {
-        free(tree);
+    /* Embedded nodes have no room for an inline key or augmentation */
+    if ((key_size > 0 || config->order_statistics || augment->size) &&
+        config->alloc_mode == RB_ALLOC_INTRUSIVE) {
         return NULL;
     }
     
-    tree->nil->color = RB_BLACK;
+    size_t node_size = sizeof(rb_node_t) + ((key_size + 7) & ~(size_t)7);
+    size_t count_offset = 0;
+    if (config->order_statistics) {
+        count_offset = node_size;
+        node_size += sizeof(size_t);
+    }
+    size_t aggregate_offset = 0;
+    if (augment->size) {
+        aggregate_offset = node_size;
+        node_size += (augment->size + 7) & ~(size_t)7;
+    }
+    rb_tree_t *tree;
+    
+    if (config->alloc_mode == RB_ALLOC_ARENA) {
+        tree = rb_arena_alloc(config->arena, sizeof(rb_tree_t));
+        if (!tree) {
+            return NULL;
+        }
+        tree->nil = rb_arena_alloc(config->arena, node_size);
+        if (!tree->nil) {
+            return NULL;
+        }
+    } else {
+        tree = malloc(sizeof(rb_tree_t));
+        if (!tree) {
+            return NULL;
+        }
+        tree->nil = malloc(node_size);
+        if (!tree->nil) {
+            free(tree);
+            return NULL;
+        }
+    }
+    
+    tree->node_size = node_size;
+    tree->count_offset = count_offset;
+    tree->aggregate_offset = aggregate_offset;
+    tree->augment = *augment;
+    tree->augment_scratch = NULL;
+    
+    rb_node_set_parent_color(tree->nil, tree->nil, RB_BLACK);
     tree->nil->left = tree->nil;
     tree->nil->right = tree->nil;
-    tree->nil->parent = tree->nil;
     tree->nil->data = NULL;
+    if (count_offset) {
+        RB_SUBTREE_COUNT(tree, tree->nil) = 0;
+    }
+    if (aggregate_offset) {
+        memcpy(RB_AGGREGATE(tree, tree->nil), augment->identity, augment->size);
+    }
     
     tree->root = tree->nil;
+    tree->leftmost = tree->nil;
+    tree->rightmost = tree->nil;
     tree->size = 0;
     tree->compare = compare_func;
     tree->free_data = free_func;
+    tree->alloc_mode = config->alloc_mode;
+    tree->node_offset = config->node_offset;
+    tree->key_type = config->key_type;
+    tree->key_size = key_size;
+    tree->arena = config->arena;
+    tree->pool_chunks = NULL;
+    tree->pool_spare = NULL;
+    tree->pool_free_list = NULL;
+    tree->pool_free_count = 0;
+    tree->pool_bump = NULL;
+    tree->pool_bump_end = NULL;
+    tree->pool_chunk_nodes = config->pool_chunk_nodes ? config->pool_chunk_nodes
+                                                      : RB_POOL_DEFAULT_CHUNK_NODES;
+    tree->payload_size = config->payload_size;
+    tree->payload_bytes = 0;
+    tree->memory_budget = config->memory_budget;
+    tree->bytes_hugepage = 0;
+    tree->hash = config->hash;
+    tree->cache = NULL;
+    tree->cache_mask = 0;
+    tree->cache_hits = 0;
+    tree->cache_misses = 0;
+    tree->filter = NULL;
+    tree->filter_block = NULL;
+    tree->filter_blocks = 0;
+    tree->filter_rejects = 0;
+    tree->filter_false_positives = 0;
+    tree->bytes_allocated = (config->alloc_mode == RB_ALLOC_ARENA)
+                            ? sizeof(rb_tree_t) + node_size
+                            : RB_MALLOC_CHARGE(tree, sizeof(rb_tree_t)) +
+                              RB_MALLOC_CHARGE(tree->nil, node_size);
+    
+    if (config->lookup_cache_slots) {
+        size_t slots = 1;
+        while (slots < config->lookup_cache_slots) {
+            slots <<= 1;
+        }
+        tree->cache = rb_mem_alloc(tree, slots * sizeof(struct rb_cache_entry));
+        if (!tree->cache) {
+            rb_tree_destroy(tree);
+            return NULL;
+        }
+        tree->cache_mask = slots - 1;
+        rb_cache_reset(tree);
+    }
+    
+    if (aggregate_offset) {
+        tree->augment_scratch = rb_mem_alloc(tree, augment->size);
+        if (!tree->augment_scratch) {
+            rb_tree_destroy(tree);
+            return NULL;
+        }
+    }
+    
+    if (config->filter_capacity) {
+        size_t blocks = (config->filter_capacity * RB_FILTER_COUNTERS_PER_KEY +
+                         RB_FILTER_BLOCK_COUNTERS - 1) / RB_FILTER_BLOCK_COUNTERS;
+        if (blocks > UINT32_MAX) {
+            blocks = UINT32_MAX;
+        }
+        tree->filter_block = rb_mem_alloc(tree, blocks * RB_FILTER_BLOCK_BYTES +
+                                                RB_FILTER_BLOCK_BYTES - 1);
+        if (!tree->filter_block) {
+            rb_tree_destroy(tree);
+            return NULL;
+        }
+        tree->filter = (uint8_t *)(((uintptr_t)tree->filter_block + RB_FILTER_BLOCK_BYTES - 1) &
+                                   ~(uintptr_t)(RB_FILTER_BLOCK_BYTES - 1));
+        tree->filter_blocks = blocks;
+        memset(tree->filter, 0, blocks * RB_FILTER_BLOCK_BYTES);
+    }
     
     return tree;
 }
 
+rb_tree_t *rb_tree_create_intrusive(rb_compare_func_t compare_func, rb_free_func_t free_func,
+                                    size_t node_offset) {
+    rb_tree_config_t config = {0};
+    config.alloc_mode = RB_ALLOC_INTRUSIVE;
+    config.node_offset = node_offset;
+    return rb_tree_create_ex(compare_func, free_func, &config);
+}
+
+rb_tree_t *rb_tree_create_keyed(rb_key_type_t key_type, size_t key_size, rb_free_func_t free_func) {
+    rb_tree_config_t config = {0};
+    config.key_type = key_type;
+    config.key_size = key_size;
+    return rb_tree_create_ex(NULL, free_func, &config);
+}
+
 static void destroy_node_data(void *data, void *context) {
     rb_tree_t *tree = (rb_tree_t *)context;
     if (tree->free_data) {
@@ -58,7 +363,7 @@ static void destroy_node_data(void *data, void *context) {
     }
 }
 
-void rb_tree_destroy(rb_tree_t *tree) {
+void rb_tree_clear(rb_tree_t *tree) {
     if (!tree) {
         return;
     }
@@ -67,313 +372,1648 @@ void rb_tree_destroy(rb_tree_t *tree) {
         rb_postorder_walk(tree, destroy_node_data, tree);
     }
     
-    rb_node_t *current = tree->root;
-    while (current != tree->nil) {
-        rb_node_t *temp = current;
-        if (current->left != tree->nil) {
-            current = current->left;
-        } else if (current->right != tree->nil) {
-            current = current->right;
-        } else {
-            current = current->parent;
-            if (current != tree->nil) {
-                if (current->left == temp) {
-                    current->left = tree->nil;
-                } else {
-                    current->right = tree->nil;
+    /* Pooled and arena nodes are released chunk by chunk and embedded nodes
+     * are owned by their records, so only malloc'd nodes need a walk */
+    if (tree->alloc_mode == RB_ALLOC_MALLOC) {
+        rb_node_t *current = tree->root;
+        while (current != tree->nil) {
+            rb_node_t *temp = current;
+            if (current->left != tree->nil) {
+                current = current->left;
+            } else if (current->right != tree->nil) {
+                current = current->right;
+            } else {
+                current = rb_node_parent(current);
+                if (current != tree->nil) {
+                    if (current->left == temp) {
+                        current->left = tree->nil;
+                    } else {
+                        current->right = tree->nil;
+                    }
                 }
+                rb_mem_free(tree, temp, tree->node_size);
             }
-            free(temp);
         }
+    } else {
+        rb_pool_release(tree);
+    }
+    
+    rb_node_set_parent(tree->nil, tree->nil);
+    tree->root = tree->nil;
+    tree->leftmost = tree->nil;
+    tree->rightmost = tree->nil;
+    tree->size = 0;
+    tree->payload_bytes = 0;
+    rb_cache_reset(tree);
+    if (tree->filter) {
+        memset(tree->filter, 0, tree->filter_blocks * RB_FILTER_BLOCK_BYTES);
+    }
+}
+
+void rb_tree_destroy(rb_tree_t *tree) {
+    if (!tree) {
+        return;
+    }
+    
+    /* The tree itself lives in the arena; the arena owner reclaims it */
+    if (tree->alloc_mode == RB_ALLOC_ARENA) {
+        return;
     }
     
+    rb_tree_clear(tree);
+    if (tree->cache) {
+        rb_mem_free(tree, tree->cache, (tree->cache_mask + 1) * sizeof(struct rb_cache_entry));
+    }
+    if (tree->filter_block) {
+        rb_mem_free(tree, tree->filter_block,
+                    tree->filter_blocks * RB_FILTER_BLOCK_BYTES + RB_FILTER_BLOCK_BYTES - 1);
+    }
+    if (tree->augment_scratch) {
+        rb_mem_free(tree, tree->augment_scratch, tree->augment.size);
+    }
     free(tree->nil);
     free(tree);
 }
 
-static rb_node_t *rb_node_create(rb_tree_t *tree, void *data) {
-    rb_node_t *node = malloc(sizeof(rb_node_t));
-    if (!node) {
-        return NULL;
+/* Hot-key cache: a direct-mapped table from key hash to node. Entries only
+ * ever point at linked nodes; every path that frees or moves a node clears
+ * them first. */
+static void rb_cache_reset(rb_tree_t *tree) {
+    if (tree->cache) {
+        memset(tree->cache, 0, (tree->cache_mask + 1) * sizeof(struct rb_cache_entry));
+    }
+}
+
+static void rb_cache_forget(rb_tree_t *tree, rb_node_t *node) {
+    if (!tree->cache) {
+        return;
     }
     
-    node->data = data;
-    node->color = RB_RED;
-    node->left = tree->nil;
-    node->right = tree->nil;
-    node->parent = tree->nil;
+    uint64_t hash = tree->hash(rb_node_key(tree, node));
+    struct rb_cache_entry *entry = &tree->cache[hash & tree->cache_mask];
+    if (entry->node == node) {
+        entry->node = NULL;
+    }
+}
+
+/* Counting blocked Bloom filter: a key hashes to one 64-byte block and to
+ * RB_FILTER_PROBES 4-bit counters inside it, so a lookup touches a single
+ * cache line. A counter that reaches 15 saturates and is never decremented
+ * again, which costs precision but can never cause a false negative. */
+static inline uint8_t *rb_filter_block_for(const rb_tree_t *tree, uint64_t *hash) {
+    /* Spread the caller's hash first; narrow hashes leave the top bits empty */
+    uint64_t mixed = (*hash ^ (*hash >> 32)) * 0x9E3779B97F4A7C15ULL;
+    size_t block = (size_t)(((mixed >> 32) * (uint64_t)tree->filter_blocks) >> 32);
     
-    return node;
+    /* Counter indices come from a second mix so that they stay independent
+     * of the bits that chose the block */
+    *hash = (mixed ^ (mixed >> 29)) * 0xBF58476D1CE4E5B9ULL;
+    return tree->filter + block * RB_FILTER_BLOCK_BYTES;
 }
 
-static void rb_node_destroy(rb_tree_t *tree, rb_node_t *node) {
-    if (node != tree->nil) {
-        if (tree->free_data) {
-            tree->free_data(node->data);
+static bool rb_filter_may_contain(const rb_tree_t *tree, uint64_t hash) {
+    uint64_t slots = hash;
+    const uint8_t *block = rb_filter_block_for(tree, &slots);
+    
+    for (int i = 0; i < RB_FILTER_PROBES; i++) {
+        unsigned slot = (unsigned)(slots >> (57 - 7 * i)) & (RB_FILTER_BLOCK_COUNTERS - 1);
+        if (((block[slot >> 1] >> ((slot & 1) * 4)) & 15) == 0) {
+            return false;
         }
-        free(node);
     }
+    return true;
 }
 
-static void rb_left_rotate(rb_tree_t *tree, rb_node_t *x) {
-    rb_node_t *y = x->right;
+static void rb_filter_update(rb_tree_t *tree, const rb_node_t *node, int delta) {
+    if (!tree->filter) {
+        return;
+    }
     
-    x->right = y->left;
-    if (y->left != tree->nil) {
-        y->left->parent = x;
+    uint64_t slots = tree->hash(rb_node_key(tree, node));
+    uint8_t *block = rb_filter_block_for(tree, &slots);
+    
+    for (int i = 0; i < RB_FILTER_PROBES; i++) {
+        unsigned slot = (unsigned)(slots >> (57 - 7 * i)) & (RB_FILTER_BLOCK_COUNTERS - 1);
+        unsigned shift = (slot & 1) * 4;
+        unsigned count = (block[slot >> 1] >> shift) & 15;
+        if (count == 15 || (delta < 0 && count == 0)) {
+            continue;
+        }
+        count = (delta > 0) ? count + 1 : count - 1;
+        block[slot >> 1] = (uint8_t)((block[slot >> 1] & ~(15u << shift)) | (count << shift));
+    }
+}
+
+/* Every node and chunk allocation goes through here so that the tree knows
+ * its own footprint and can refuse to grow past its budget */
+static void *rb_mem_alloc(rb_tree_t *tree, size_t bytes) {
+    if (tree->memory_budget &&
+        tree->bytes_allocated + tree->payload_bytes + bytes > tree->memory_budget) {
+        return NULL;
     }
     
-    y->parent = x->parent;
-    if (x->parent == tree->nil) {
-        tree->root = y;
-    } else if (x == x->parent->left) {
-        x->parent->left = y;
-    } else {
-        x->parent->right = y;
+    if (tree->alloc_mode == RB_ALLOC_ARENA) {
+        void *ptr = rb_arena_alloc(tree->arena, bytes);
+        if (ptr) {
+            tree->bytes_allocated += bytes;
+        }
+        return ptr;
     }
     
-    y->left = x;
-    x->parent = y;
+    void *ptr = malloc(bytes);
+    if (ptr) {
+        tree->bytes_allocated += RB_MALLOC_CHARGE(ptr, bytes);
+    }
+    return ptr;
 }
 
-static void rb_right_rotate(rb_tree_t *tree, rb_node_t *y) {
-    rb_node_t *x = y->left;
+static void rb_mem_free(rb_tree_t *tree, void *ptr, size_t bytes) {
+    /* Arena memory stays with the arena; the tree just stops owning it */
+    if (tree->alloc_mode == RB_ALLOC_ARENA) {
+        tree->bytes_allocated -= bytes;
+        return;
+    }
     
-    y->left = x->right;
-    if (x->right != tree->nil) {
-        x->right->parent = y;
+    tree->bytes_allocated -= RB_MALLOC_CHARGE(ptr, bytes);
+    free(ptr);
+}
+
+/* Slab chunks: malloc'd (or arena) blocks, or whole 2 MB-aligned mappings
+ * advised as huge pages so that one TLB entry covers thousands of nodes */
+#ifdef RB_HAVE_MMAP
+static void *rb_hugepage_map(size_t length) {
+    /* Over-map by one huge page and trim so the region starts on a boundary */
+    size_t span = length + RB_HUGEPAGE_SIZE;
+    char *raw = mmap(NULL, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) {
+        return NULL;
     }
     
-    x->parent = y->parent;
-    if (y->parent == tree->nil) {
-        tree->root = x;
-    } else if (y == y->parent->left) {
-        y->parent->left = x;
+    char *base = (char *)(((uintptr_t)raw + RB_HUGEPAGE_SIZE - 1) & ~(uintptr_t)(RB_HUGEPAGE_SIZE - 1));
+    if (base > raw) {
+        munmap(raw, (size_t)(base - raw));
+    }
+    if (raw + span > base + length) {
+        munmap(base + length, (size_t)(raw + span - (base + length)));
+    }
+    
+#ifdef MADV_HUGEPAGE
+    madvise(base, length, MADV_HUGEPAGE);
+#endif
+    return base;
+}
+#endif
+
+static struct rb_pool_chunk *rb_chunk_alloc(rb_tree_t *tree, size_t nodes) {
+    size_t bytes = RB_POOL_CHUNK_HEADER + nodes * tree->node_size;
+    struct rb_pool_chunk *chunk = NULL;
+    
+#ifdef RB_HAVE_MMAP
+    if (tree->alloc_mode == RB_ALLOC_HUGEPAGE) {
+        size_t length = (bytes + RB_HUGEPAGE_SIZE - 1) & ~(RB_HUGEPAGE_SIZE - 1);
+        if (tree->memory_budget &&
+            tree->bytes_allocated + tree->payload_bytes + length > tree->memory_budget) {
+            return NULL;
+        }
+        
+        chunk = rb_hugepage_map(length);
+        if (chunk) {
+            chunk->mapped = length;
+            tree->bytes_allocated += length;
+            tree->bytes_hugepage += length;
+        }
+    }
+#endif
+    
+    /* Plain pools, arenas and huge page trees whose mmap failed */
+    if (!chunk) {
+        chunk = rb_mem_alloc(tree, bytes);
+        if (!chunk) {
+            return NULL;
+        }
+        chunk->mapped = 0;
+    }
+    
+    chunk->next = NULL;
+    chunk->capacity = nodes;
+    return chunk;
+}
+
+static void rb_chunk_free(rb_tree_t *tree, struct rb_pool_chunk *chunk) {
+#ifdef RB_HAVE_MMAP
+    if (chunk->mapped) {
+        tree->bytes_allocated -= chunk->mapped;
+        tree->bytes_hugepage -= chunk->mapped;
+        munmap(chunk, chunk->mapped);
+        return;
+    }
+#endif
+    rb_mem_free(tree, chunk, RB_POOL_CHUNK_HEADER + chunk->capacity * tree->node_size);
+}
+
+/* Slab allocator: carve nodes from large chunks, recycle through a free list */
+static rb_result_t rb_pool_grow(rb_tree_t *tree, size_t nodes) {
+    /* A mapping is all huge pages anyway, so fill it completely */
+    if (tree->alloc_mode == RB_ALLOC_HUGEPAGE) {
+        size_t bytes = RB_POOL_CHUNK_HEADER + nodes * tree->node_size;
+        size_t length = (bytes + RB_HUGEPAGE_SIZE - 1) & ~(RB_HUGEPAGE_SIZE - 1);
+        nodes = (length - RB_POOL_CHUNK_HEADER) / tree->node_size;
+    }
+    
+    /* Arena memory only comes back on rb_arena_reset, so chunks emptied by
+     * clear or compaction are refilled before the arena is asked for more.
+     * Any spare will do, however small: rb_tree_capacity counts them all */
+    struct rb_pool_chunk *chunk = tree->pool_spare;
+    if (chunk) {
+        tree->pool_spare = chunk->next;
+        nodes = chunk->capacity;
     } else {
-        y->parent->right = x;
+        chunk = rb_chunk_alloc(tree, nodes);
+        if (!chunk) {
+            return RB_MEMORY_ERROR;
+        }
     }
     
-    x->right = y;
-    y->parent = x;
+    /* Keep the tail of the previous chunk reachable through the free list */
+    while (tree->pool_bump < tree->pool_bump_end) {
+        rb_node_t *node = (rb_node_t *)tree->pool_bump;
+        node->left = tree->pool_free_list;
+        tree->pool_free_list = node;
+        tree->pool_free_count++;
+        tree->pool_bump += tree->node_size;
+    }
+    
+    chunk->next = tree->pool_chunks;
+    tree->pool_chunks = chunk;
+    tree->pool_bump = (char *)chunk + RB_POOL_CHUNK_HEADER;
+    tree->pool_bump_end = tree->pool_bump + nodes * tree->node_size;
+    
+    return RB_OK;
 }
 
-static void rb_insert_fixup(rb_tree_t *tree, rb_node_t *z) {
-    while (z->parent->color == RB_RED) {
-        if (z->parent == z->parent->parent->left) {
-            rb_node_t *y = z->parent->parent->right;
-            if (y->color == RB_RED) {
-                z->parent->color = RB_BLACK;
-                y->color = RB_BLACK;
-                z->parent->parent->color = RB_RED;
-                z = z->parent->parent;
-            } else {
-                if (z == z->parent->right) {
-                    z = z->parent;
-                    rb_left_rotate(tree, z);
-                }
-                z->parent->color = RB_BLACK;
-                z->parent->parent->color = RB_RED;
-                rb_right_rotate(tree, z->parent->parent);
-            }
+static void rb_pool_release(rb_tree_t *tree) {
+    /* Arena chunks stay charged to the tree as spares for rb_pool_grow;
+     * the arena itself reclaims them on rb_arena_reset/rb_arena_destroy */
+    struct rb_pool_chunk *chunk = tree->pool_chunks;
+    while (chunk) {
+        struct rb_pool_chunk *next = chunk->next;
+        if (tree->alloc_mode == RB_ALLOC_ARENA) {
+            chunk->next = tree->pool_spare;
+            tree->pool_spare = chunk;
         } else {
-            rb_node_t *y = z->parent->parent->left;
-            if (y->color == RB_RED) {
-                z->parent->color = RB_BLACK;
-                y->color = RB_BLACK;
-                z->parent->parent->color = RB_RED;
-                z = z->parent->parent;
-            } else {
-                if (z == z->parent->left) {
-                    z = z->parent;
-                    rb_right_rotate(tree, z);
-                }
-                z->parent->color = RB_BLACK;
-                z->parent->parent->color = RB_RED;
-                rb_left_rotate(tree, z->parent->parent);
-            }
+            rb_chunk_free(tree, chunk);
         }
+        chunk = next;
     }
-    tree->root->color = RB_BLACK;
+    
+    tree->pool_chunks = NULL;
+    tree->pool_free_list = NULL;
+    tree->pool_free_count = 0;
+    tree->pool_bump = NULL;
+    tree->pool_bump_end = NULL;
 }
 
-rb_result_t rb_insert(rb_tree_t *tree, void *data) {
-    if (!tree || !data) {
+static rb_node_t *rb_node_alloc(rb_tree_t *tree) {
+    if (!RB_USES_POOL(tree)) {
+        return rb_mem_alloc(tree, tree->node_size);
+    }
+    
+    if (tree->pool_free_list) {
+        rb_node_t *node = tree->pool_free_list;
+        tree->pool_free_list = node->left;
+        tree->pool_free_count--;
+        return node;
+    }
+    
+    if (tree->pool_bump == tree->pool_bump_end &&
+        rb_pool_grow(tree, tree->pool_chunk_nodes) != RB_OK) {
+        return NULL;
+    }
+    
+    rb_node_t *node = (rb_node_t *)tree->pool_bump;
+    tree->pool_bump += tree->node_size;
+    return node;
+}
+
+static void rb_node_free(rb_tree_t *tree, rb_node_t *node) {
+    if (tree->alloc_mode == RB_ALLOC_INTRUSIVE) {
+        return;
+    }
+    
+    if (!RB_USES_POOL(tree)) {
+        rb_mem_free(tree, node, tree->node_size);
+        return;
+    }
+    
+    node->left = tree->pool_free_list;
+    tree->pool_free_list = node;
+    tree->pool_free_count++;
+}
+
+size_t rb_tree_capacity(rb_tree_t *tree) {
+    if (!tree) {
+        return 0;
+    }
+    
+    if (!RB_USES_POOL(tree)) {
+        return tree->size;
+    }
+    
+    size_t bump_nodes = (size_t)(tree->pool_bump_end - tree->pool_bump) / tree->node_size;
+    for (struct rb_pool_chunk *chunk = tree->pool_spare; chunk; chunk = chunk->next) {
+        bump_nodes += chunk->capacity;
+    }
+    return tree->size + tree->pool_free_count + bump_nodes;
+}
+
+rb_result_t rb_tree_reserve(rb_tree_t *tree, size_t capacity) {
+    if (!tree || !RB_USES_POOL(tree)) {
         return RB_ERROR;
     }
     
-    rb_node_t *z = rb_node_create(tree, data);
-    if (!z) {
-        return RB_MEMORY_ERROR;
+    size_t available = rb_tree_capacity(tree);
+    if (available >= capacity) {
+        return RB_OK;
     }
     
-    rb_node_t *y = tree->nil;
-    rb_node_t *x = tree->root;
+    size_t needed = capacity - available;
+    if (needed < tree->pool_chunk_nodes) {
+        needed = tree->pool_chunk_nodes;
+    }
+    
+    /* Spares already count toward available, so the new chunk joins them */
+    if (tree->pool_spare) {
+        struct rb_pool_chunk *chunk = rb_chunk_alloc(tree, needed);
+        if (!chunk) {
+            return RB_MEMORY_ERROR;
+        }
+        chunk->next = tree->pool_spare;
+        tree->pool_spare = chunk;
+        return RB_OK;
+    }
+    
+    return rb_pool_grow(tree, needed);
+}
+
+size_t rb_tree_bytes_allocated(rb_tree_t *tree) {
+    return tree ? tree->bytes_allocated : 0;
+}
+
+size_t rb_tree_payload_bytes(rb_tree_t *tree) {
+    return tree ? tree->payload_bytes : 0;
+}
+
+size_t rb_tree_hugepage_bytes(rb_tree_t *tree) {
+    return tree ? tree->bytes_hugepage : 0;
+}
+
+size_t rb_tree_filter_bytes(rb_tree_t *tree) {
+    return tree ? tree->filter_blocks * RB_FILTER_BLOCK_BYTES : 0;
+}
+
+rb_result_t rb_tree_set_memory_budget(rb_tree_t *tree, size_t bytes) {
+    if (!tree) {
+        return RB_ERROR;
+    }
+    
+    tree->memory_budget = bytes;
+    return RB_OK;
+}
+
+/* Cache-oblivious relayout: emit nodes in the requested order, copy them into
+ * one block and rewire the links */
+static void rb_layout_veb(rb_tree_t *tree, rb_node_t *node, int height,
+                          rb_node_t **order, size_t *count);
+
+static void rb_layout_veb_bottoms(rb_tree_t *tree, rb_node_t *node, int depth, int height,
+                                  rb_node_t **order, size_t *count) {
+    if (node == tree->nil) {
+        return;
+    }
+    
+    if (depth == 0) {
+        rb_layout_veb(tree, node, height, order, count);
+        return;
+    }
+    
+    rb_layout_veb_bottoms(tree, node->left, depth - 1, height, order, count);
+    rb_layout_veb_bottoms(tree, node->right, depth - 1, height, order, count);
+}
+
+static void rb_layout_veb(rb_tree_t *tree, rb_node_t *node, int height,
+                          rb_node_t **order, size_t *count) {
+    if (node == tree->nil || height <= 0) {
+        return;
+    }
+    
+    if (height == 1) {
+        order[(*count)++] = node;
+        return;
+    }
+    
+    /* Top half first, then every bottom subtree left to right */
+    int top = height / 2;
+    rb_layout_veb(tree, node, top, order, count);
+    rb_layout_veb_bottoms(tree, node, top, height - top, order, count);
+}
+
+static void rb_layout_dfs(rb_tree_t *tree, rb_node_t *node, rb_node_t **order, size_t *count) {
+    if (node != tree->nil) {
+        order[(*count)++] = node;
+        rb_layout_dfs(tree, node->left, order, count);
+        rb_layout_dfs(tree, node->right, order, count);
+    }
+}
+
+static void rb_layout_bfs(rb_tree_t *tree, rb_node_t **order, size_t *count) {
+    /* The output array doubles as the BFS queue */
+    size_t head = 0;
+    order[(*count)++] = tree->root;
+    while (head < *count) {
+        rb_node_t *node = order[head++];
+        if (node->left != tree->nil) {
+            order[(*count)++] = node->left;
+        }
+        if (node->right != tree->nil) {
+            order[(*count)++] = node->right;
+        }
+    }
+}
+
+rb_result_t rb_tree_compact(rb_tree_t *tree, rb_layout_t layout) {
+    if (!tree || tree->alloc_mode == RB_ALLOC_INTRUSIVE) {
+        return RB_ERROR;
+    }
+    
+    if (layout != RB_LAYOUT_VEB && layout != RB_LAYOUT_BFS && layout != RB_LAYOUT_DFS) {
+        return RB_ERROR;
+    }
+    
+    if (tree->size == 0) {
+        return RB_OK;
+    }
+    
+    rb_node_t **order = malloc(sizeof(rb_node_t *) * tree->size);
+    if (!order) {
+        return RB_MEMORY_ERROR;
+    }
+    
+    size_t count = 0;
+    switch (layout) {
+        case RB_LAYOUT_VEB:
+            rb_layout_veb(tree, tree->root, rb_height_node(tree, tree->root), order, &count);
+            break;
+        case RB_LAYOUT_BFS:
+            rb_layout_bfs(tree, order, &count);
+            break;
+        case RB_LAYOUT_DFS:
+            rb_layout_dfs(tree, tree->root, order, &count);
+            break;
+    }
+    assert(count == tree->size);
+    
+    struct rb_pool_chunk *chunk = rb_chunk_alloc(tree, count);
+    if (!chunk) {
+        free(order);
+        return RB_MEMORY_ERROR;
+    }
+    
+    char *block = (char *)chunk + RB_POOL_CHUNK_HEADER;
+    for (size_t i = 0; i < count; i++) {
+        memcpy(block + i * tree->node_size, order[i], tree->node_size);
+    }
+    
+    /* Old nodes are dead once copied; their data field now forwards to the copy */
+    for (size_t i = 0; i < count; i++) {
+        order[i]->data = block + i * tree->node_size;
+    }
+    
+#define RB_RELOCATED(n) ((n) == tree->nil ? tree->nil : (rb_node_t *)(n)->data)
+    for (size_t i = 0; i < count; i++) {
+        rb_node_t *node = (rb_node_t *)(block + i * tree->node_size);
+        node->left = RB_RELOCATED(node->left);
+        node->right = RB_RELOCATED(node->right);
+        rb_node_set_parent(node, RB_RELOCATED(rb_node_parent(node)));
+    }
+    tree->root = RB_RELOCATED(tree->root);
+    tree->leftmost = RB_RELOCATED(tree->leftmost);
+    tree->rightmost = RB_RELOCATED(tree->rightmost);
+#undef RB_RELOCATED
+    
+    /* Release the scattered storage, then adopt the block as a full slab.
+     * Malloc trees stay pooled from here on: their nodes share the block */
+    if (tree->alloc_mode == RB_ALLOC_MALLOC) {
+        for (size_t i = 0; i < count; i++) {
+            rb_mem_free(tree, order[i], tree->node_size);
+        }
+        tree->alloc_mode = RB_ALLOC_POOL;
+    } else {
+        rb_pool_release(tree);
+    }
+    free(order);
+    
+    chunk->next = tree->pool_chunks;
+    tree->pool_chunks = chunk;
+    tree->pool_bump = block + count * tree->node_size;
+    tree->pool_bump_end = tree->pool_bump;
+    rb_node_set_parent(tree->nil, tree->nil);
+    rb_cache_reset(tree);
+    
+    return RB_OK;
+}
+
+static rb_node_t *rb_node_create(rb_tree_t *tree, const void *key, void *data) {
+    rb_node_t *node = (tree->alloc_mode == RB_ALLOC_INTRUSIVE)
+                      ? (rb_node_t *)((char *)data + tree->node_offset)
+                      : rb_node_alloc(tree);
+    if (!node) {
+        return NULL;
+    }
+    
+    node->data = data;
+    rb_node_set_parent_color(node, tree->nil, RB_RED);
+    node->left = tree->nil;
+    node->right = tree->nil;
+    if (tree->key_type == RB_KEY_STRING) {
+        rb_string_key_t *string_key = RB_INLINE_KEY(node);
+        string_key->prefix = rb_string_prefix(key);
+        string_key->str = key;
+    } else if (tree->key_size > 0) {
+        memcpy(RB_INLINE_KEY(node), key, tree->key_size);
+    }
+    
+    return node;
+}
+
+static void rb_node_destroy(rb_tree_t *tree, rb_node_t *node) {
+    if (node != tree->nil) {
+        void *data = node->data;
+        if (tree->payload_size) {
+            tree->payload_bytes -= tree->payload_size(data);
+        }
+        rb_node_free(tree, node);
+        if (tree->free_data) {
+            tree->free_data(data);
+        }
+    }
+}
+
+static void rb_left_rotate(rb_tree_t *tree, rb_node_t *x) {
+    rb_node_t *y = x->right;
+    
+    x->right = y->left;
+    if (y->left != tree->nil) {
+        rb_node_set_parent(y->left, x);
+    }
+    
+    rb_node_set_parent(y, rb_node_parent(x));
+    if (rb_node_parent(x) == tree->nil) {
+        tree->root = y;
+    } else if (x == rb_node_parent(x)->left) {
+        rb_node_parent(x)->left = y;
+    } else {
+        rb_node_parent(x)->right = y;
+    }
+    
+    y->left = x;
+    rb_node_set_parent(x, y);
+    
+    if (RB_AUGMENTED(tree)) {
+        rb_augment_rotate(tree, x, y);
+    }
+}
+
+static void rb_right_rotate(rb_tree_t *tree, rb_node_t *y) {
+    rb_node_t *x = y->left;
+    
+    y->left = x->right;
+    if (x->right != tree->nil) {
+        rb_node_set_parent(x->right, y);
+    }
+    
+    rb_node_set_parent(x, rb_node_parent(y));
+    if (rb_node_parent(y) == tree->nil) {
+        tree->root = x;
+    } else if (y == rb_node_parent(y)->left) {
+        rb_node_parent(y)->left = x;
+    } else {
+        rb_node_parent(y)->right = x;
+    }
+    
+    x->right = y;
+    rb_node_set_parent(y, x);
+    
+    if (RB_AUGMENTED(tree)) {
+        rb_augment_rotate(tree, y, x);
+    }
+}
+
+static void rb_insert_fixup(rb_tree_t *tree, rb_node_t *z) {
+    while (rb_node_color(rb_node_parent(z)) == RB_RED) {
+        if (rb_node_parent(z) == rb_node_parent(rb_node_parent(z))->left) {
+            rb_node_t *y = rb_node_parent(rb_node_parent(z))->right;
+            if (rb_node_color(y) == RB_RED) {
+                rb_node_set_color(rb_node_parent(z), RB_BLACK);
+                rb_node_set_color(y, RB_BLACK);
+                rb_node_set_color(rb_node_parent(rb_node_parent(z)), RB_RED);
+                z = rb_node_parent(rb_node_parent(z));
+            } else {
+                if (z == rb_node_parent(z)->right) {
+                    z = rb_node_parent(z);
+                    rb_left_rotate(tree, z);
+                }
+                rb_node_set_color(rb_node_parent(z), RB_BLACK);
+                rb_node_set_color(rb_node_parent(rb_node_parent(z)), RB_RED);
+                rb_right_rotate(tree, rb_node_parent(rb_node_parent(z)));
+            }
+        } else {
+            rb_node_t *y = rb_node_parent(rb_node_parent(z))->left;
+            if (rb_node_color(y) == RB_RED) {
+                rb_node_set_color(rb_node_parent(z), RB_BLACK);
+                rb_node_set_color(y, RB_BLACK);
+                rb_node_set_color(rb_node_parent(rb_node_parent(z)), RB_RED);
+                z = rb_node_parent(rb_node_parent(z));
+            } else {
+                if (z == rb_node_parent(z)->left) {
+                    z = rb_node_parent(z);
+                    rb_right_rotate(tree, z);
+                }
+                rb_node_set_color(rb_node_parent(z), RB_BLACK);
+                rb_node_set_color(rb_node_parent(rb_node_parent(z)), RB_RED);
+                rb_left_rotate(tree, rb_node_parent(rb_node_parent(z)));
+            }
+        }
+    }
+    rb_node_set_color(tree->root, RB_BLACK);
+}
+
+/* First 8 bytes of a string, zero padded, as a big-endian integer: integer
+ * order on prefixes matches strcmp order on the strings */
+static inline uint64_t rb_string_prefix(const char *str) {
+    uint64_t prefix = 0;
+    for (int i = 0; i < 8 && str[i]; i++) {
+        prefix |= (uint64_t)(unsigned char)str[i] << (56 - 8 * i);
+    }
+    return prefix;
+}
+
+/* Three-way comparison of a probe key against a node, without callbacks
+ * for inline key types */
+static inline int rb_key_cmp(const rb_tree_t *tree, const void *key, const rb_node_t *node) {
+    switch (tree->key_type) {
+        case RB_KEY_INT64: {
+            int64_t a, b;
+            memcpy(&a, key, sizeof(a));
+            b = *(const int64_t *)RB_INLINE_KEY(node);
+            return (a > b) - (a < b);
+        }
+        case RB_KEY_UINT64: {
+            uint64_t a, b;
+            memcpy(&a, key, sizeof(a));
+            b = *(const uint64_t *)RB_INLINE_KEY(node);
+            return (a > b) - (a < b);
+        }
+        case RB_KEY_DOUBLE: {
+            double a, b;
+            memcpy(&a, key, sizeof(a));
+            b = *(const double *)RB_INLINE_KEY(node);
+            return (a > b) - (a < b);
+        }
+        case RB_KEY_BYTES:
+            return memcmp(key, RB_INLINE_KEY(node), tree->key_size);
+        case RB_KEY_STRING: {
+            uint64_t a = rb_string_prefix(key);
+            uint64_t b = RB_STRING_KEY(node)->prefix;
+            return (a != b) ? ((a > b) - (a < b)) : strcmp(key, RB_STRING_KEY(node)->str);
+        }
+        default:
+            return tree->compare(key, node->data);
+    }
+}
+
+const void *rb_node_key(const rb_tree_t *tree, const rb_node_t *node) {
+    if (!tree || !node) {
+        return NULL;
+    }
+    
+    switch (tree->key_type) {
+        case RB_KEY_GENERIC:
+            return node->data;
+        case RB_KEY_STRING:
+            return RB_STRING_KEY(node)->str;
+        default:
+            return RB_INLINE_KEY(node);
+    }
+}
+
+int rb_compare_key(const rb_tree_t *tree, const void *key, const rb_node_t *node) {
+    return rb_key_cmp(tree, key, node);
+}
+
+/* One descent for every insert-like operation: returns the node holding key,
+ * or nil with *parent and *cmp describing the empty slot the key belongs in */
+static rb_node_t *rb_find_slot(rb_tree_t *tree, const void *key, rb_node_t **parent, int *cmp) {
+    rb_node_t *y = tree->nil;
+    rb_node_t *x = tree->root;
+    int c = 0;
+    
+    /* Appends past the current maximum link straight below it */
+    if (tree->rightmost != tree->nil) {
+        c = rb_key_cmp(tree, key, tree->rightmost);
+        if (c >= 0) {
+            *parent = tree->rightmost;
+            *cmp = c;
+            return (c == 0) ? tree->rightmost : tree->nil;
+        }
+    }
+    
+    while (x != tree->nil) {
+        y = x;
+        c = rb_key_cmp(tree, key, x);
+        if (c < 0) {
+            x = x->left;
+        } else if (c > 0) {
+            x = x->right;
+        } else {
+            return x;
+        }
+    }
+    
+    *parent = y;
+    *cmp = c;
+    return tree->nil;
+}
+
+static rb_result_t rb_insert_node_key(rb_tree_t *tree, const void *key, void *data) {
+    rb_node_t *parent;
+    int cmp;
+    
+    if (rb_find_slot(tree, key, &parent, &cmp) != tree->nil) {
+        return RB_DUPLICATE;
+    }
+    
+    return rb_link_new_node(tree, parent, cmp, key, data, NULL);
+}
+
+/* Hang a detached node below parent (on the side given by cmp), then
+ * rebalance. parent == nil makes it the root. */
+static void rb_link_node(rb_tree_t *tree, rb_node_t *parent, int cmp, rb_node_t *z) {
+    rb_node_set_parent_color(z, parent, RB_RED);
+    z->left = tree->nil;
+    z->right = tree->nil;
+    if (parent == tree->nil) {
+        tree->root = z;
+    } else if (cmp < 0) {
+        parent->left = z;
+    } else {
+        parent->right = z;
+    }
+    
+    if (parent == tree->nil || (parent == tree->leftmost && cmp < 0)) {
+        tree->leftmost = z;
+    }
+    if (parent == tree->nil || (parent == tree->rightmost && cmp > 0)) {
+        tree->rightmost = z;
+    }
+    
+    /* Sizes can be bumped in place; aggregates must be recombined */
+    if (tree->aggregate_offset) {
+        rb_augment_propagate(tree, z);
+    } else if (tree->count_offset) {
+        RB_SUBTREE_COUNT(tree, z) = 1;
+        for (rb_node_t *p = parent; p != tree->nil; p = rb_node_parent(p)) {
+            RB_SUBTREE_COUNT(tree, p)++;
+        }
+    }
+    
+    rb_insert_fixup(tree, z);
+    rb_filter_update(tree, z, 1);
+    tree->size++;
+}
+
+/* Create a node and link it; the payload is charged up front so that the
+ * node allocation sees it against the budget */
+static rb_result_t rb_link_new_node(rb_tree_t *tree, rb_node_t *parent, int cmp,
+                                    const void *key, void *data, rb_node_t **node_out) {
+    size_t payload = tree->payload_size ? tree->payload_size(data) : 0;
+    if (tree->memory_budget &&
+        tree->bytes_allocated + tree->payload_bytes + payload > tree->memory_budget) {
+        return RB_MEMORY_ERROR;
+    }
+    tree->payload_bytes += payload;
+    
+    /* Allocate only once we know the node will be linked; an intrusive
+     * record that is already in the tree must not have its links reset */
+    rb_node_t *z = rb_node_create(tree, key, data);
+    if (!z) {
+        tree->payload_bytes -= payload;
+        return RB_MEMORY_ERROR;
+    }
+    
+    rb_link_node(tree, parent, cmp, z);
+    
+    if (node_out) {
+        *node_out = z;
+    }
+    return RB_OK;
+}
+
+rb_result_t rb_insert(rb_tree_t *tree, void *data) {
+    if (!tree || !data || tree->key_type != RB_KEY_GENERIC) {
+        return RB_ERROR;
+    }
+    
+    return rb_insert_node_key(tree, data, data);
+}
+
+rb_result_t rb_insert_key(rb_tree_t *tree, const void *key, void *data) {
+    if (!tree || !key || !data || tree->key_type == RB_KEY_GENERIC) {
+        return RB_ERROR;
+    }
+    
+    return rb_insert_node_key(tree, key, data);
+}
+
+static void *rb_insert_or_get_key(rb_tree_t *tree, const void *key, void *data) {
+    rb_node_t *parent;
+    int cmp;
+    
+    rb_node_t *node = rb_find_slot(tree, key, &parent, &cmp);
+    if (node != tree->nil) {
+        return node->data;
+    }
+    
+    if (rb_link_new_node(tree, parent, cmp, key, data, NULL) != RB_OK) {
+        return NULL;
+    }
+    return data;
+}
+
+void *rb_insert_or_get(rb_tree_t *tree, void *data) {
+    if (!tree || !data || tree->key_type != RB_KEY_GENERIC) {
+        return NULL;
+    }
+    
+    return rb_insert_or_get_key(tree, data, data);
+}
+
+void *rb_insert_key_or_get(rb_tree_t *tree, const void *key, void *data) {
+    if (!tree || !key || !data || tree->key_type == RB_KEY_GENERIC) {
+        return NULL;
+    }
+    
+    return rb_insert_or_get_key(tree, key, data);
+}
+
+/* Swap the payload of a linked node for one with an equal key. String keys
+ * point into caller memory, so they follow the new key. */
+static void rb_node_replace_data(rb_tree_t *tree, rb_node_t *node, const void *key, void *data) {
+    if (tree->payload_size) {
+        tree->payload_bytes -= tree->payload_size(node->data);
+        tree->payload_bytes += tree->payload_size(data);
+    }
+    if (tree->key_type == RB_KEY_STRING) {
+        ((rb_string_key_t *)RB_INLINE_KEY(node))->str = key;
+    }
+    node->data = data;
+    if (tree->aggregate_offset) {
+        rb_augment_propagate(tree, node);
+    }
+}
+
+static rb_result_t rb_upsert_node_key(rb_tree_t *tree, const void *key, void *data, void **replaced) {
+    rb_node_t *parent;
+    int cmp;
+    
+    if (replaced) {
+        *replaced = NULL;
+    }
+    
+    rb_node_t *node = rb_find_slot(tree, key, &parent, &cmp);
+    if (node == tree->nil) {
+        return rb_link_new_node(tree, parent, cmp, key, data, NULL);
+    }
+    
+    /* Embedded nodes cannot move to another record */
+    if (tree->alloc_mode == RB_ALLOC_INTRUSIVE) {
+        return RB_ERROR;
+    }
+    
+    void *old = node->data;
+    if (old == data) {
+        return RB_OK;
+    }
+    if (tree->memory_budget && tree->payload_size &&
+        tree->bytes_allocated + tree->payload_bytes - tree->payload_size(old) +
+        tree->payload_size(data) > tree->memory_budget) {
+        return RB_MEMORY_ERROR;
+    }
+    rb_node_replace_data(tree, node, key, data);
+    if (replaced) {
+        *replaced = old;
+    } else if (tree->free_data) {
+        tree->free_data(old);
+    }
+    return RB_OK;
+}
+
+rb_result_t rb_upsert(rb_tree_t *tree, void *data, void **replaced) {
+    if (!tree || !data || tree->key_type != RB_KEY_GENERIC) {
+        return RB_ERROR;
+    }
+    
+    return rb_upsert_node_key(tree, data, data, replaced);
+}
+
+rb_result_t rb_upsert_key(rb_tree_t *tree, const void *key, void *data, void **replaced) {
+    if (!tree || !key || !data || tree->key_type == RB_KEY_GENERIC) {
+        return RB_ERROR;
+    }
+    
+    return rb_upsert_node_key(tree, key, data, replaced);
+}
+
+rb_result_t rb_emplace(rb_tree_t *tree, const void *key, rb_construct_func_t construct,
+                       void *context, void **element) {
+    if (element) {
+        *element = NULL;
+    }
+    if (!tree || !key || !construct) {
+        return RB_ERROR;
+    }
+    
+    /* A string tree would keep the probe pointer, which typically dies
+     * with the caller's frame while the payload holds its own copy */
+    if (tree->key_type == RB_KEY_STRING) {
+        return RB_ERROR;
+    }
+    
+    rb_node_t *parent;
+    int cmp;
+    rb_node_t *node = rb_find_slot(tree, key, &parent, &cmp);
+    if (node != tree->nil) {
+        if (element) {
+            *element = node->data;
+        }
+        return RB_DUPLICATE;
+    }
+    
+    void *data = construct(key, context);
+    if (!data) {
+        return RB_MEMORY_ERROR;
+    }
+    
+    /* Generic trees compare payloads, so the new payload is the stored key */
+    const void *stored_key = (tree->key_type == RB_KEY_GENERIC) ? data : key;
+    rb_result_t result = rb_link_new_node(tree, parent, cmp, stored_key, data, NULL);
+    if (result != RB_OK) {
+        if (tree->free_data) {
+            tree->free_data(data);
+        }
+        return result;
+    }
+    
+    if (element) {
+        *element = data;
+    }
+    return RB_OK;
+}
+
+/* Insert next to a hint node: if the key falls between the hint and one of
+ * its neighbours, the new node takes the free child slot on that side, found
+ * by walking links only. Two comparisons; otherwise a normal insert. */
+static rb_result_t rb_insert_hinted(rb_tree_t *tree, rb_node_t *hint, const void *key, void *data) {
+    if (!hint || hint == tree->nil) {
+        return rb_insert_node_key(tree, key, data);
+    }
+    
+    int cmp = rb_key_cmp(tree, key, hint);
+    if (cmp == 0) {
+        return RB_DUPLICATE;
+    }
+    
+    if (cmp > 0) {
+        rb_node_t *next = rb_tree_successor_node(tree, hint);
+        int next_cmp = (next != tree->nil) ? rb_key_cmp(tree, key, next) : -1;
+        if (next_cmp < 0) {
+            /* Either hint has no right child, or its successor (the leftmost
+             * node of that subtree) has no left child */
+            if (hint->right == tree->nil) {
+                return rb_link_new_node(tree, hint, 1, key, data, NULL);
+            }
+            return rb_link_new_node(tree, next, -1, key, data, NULL);
+        }
+        if (next_cmp == 0) {
+            return RB_DUPLICATE;
+        }
+    } else {
+        rb_node_t *prev = rb_tree_predecessor_node(tree, hint);
+        int prev_cmp = (prev != tree->nil) ? rb_key_cmp(tree, key, prev) : 1;
+        if (prev_cmp > 0) {
+            if (hint->left == tree->nil) {
+                return rb_link_new_node(tree, hint, -1, key, data, NULL);
+            }
+            return rb_link_new_node(tree, prev, 1, key, data, NULL);
+        }
+        if (prev_cmp == 0) {
+            return RB_DUPLICATE;
+        }
+    }
+    
+    return rb_insert_node_key(tree, key, data);
+}
+
+rb_result_t rb_insert_hint(rb_tree_t *tree, rb_node_t *hint, void *data) {
+    if (!tree || !data || tree->key_type != RB_KEY_GENERIC) {
+        return RB_ERROR;
+    }
+    
+    return rb_insert_hinted(tree, hint, data, data);
+}
+
+rb_result_t rb_insert_key_hint(rb_tree_t *tree, rb_node_t *hint, const void *key, void *data) {
+    if (!tree || !key || !data || tree->key_type == RB_KEY_GENERIC) {
+        return RB_ERROR;
+    }
+    
+    return rb_insert_hinted(tree, hint, key, data);
+}
+
+/* Recompute a node's size and aggregate from its children */
+static void rb_augment_update(rb_tree_t *tree, rb_node_t *node) {
+    if (tree->count_offset) {
+        RB_SUBTREE_COUNT(tree, node) = RB_SUBTREE_COUNT(tree, node->left) +
+                                       RB_SUBTREE_COUNT(tree, node->right) + 1;
+    }
+    if (tree->aggregate_offset) {
+        void *aggregate = RB_AGGREGATE(tree, node);
+        memcpy(aggregate, RB_AGGREGATE(tree, node->left), tree->augment.size);
+        tree->augment.value(tree->augment_scratch, node->data);
+        tree->augment.combine(aggregate, tree->augment_scratch);
+        tree->augment.combine(aggregate, RB_AGGREGATE(tree, node->right));
+    }
+}
+
+/* After a rotation new_top spans exactly the elements old_top used to */
+static void rb_augment_rotate(rb_tree_t *tree, rb_node_t *old_top, rb_node_t *new_top) {
+    if (tree->count_offset) {
+        RB_SUBTREE_COUNT(tree, new_top) = RB_SUBTREE_COUNT(tree, old_top);
+    }
+    if (tree->aggregate_offset) {
+        memcpy(RB_AGGREGATE(tree, new_top), RB_AGGREGATE(tree, old_top), tree->augment.size);
+    }
+    rb_augment_update(tree, old_top);
+}
+
+static void rb_augment_propagate(rb_tree_t *tree, rb_node_t *node) {
+    for (; node != tree->nil; node = rb_node_parent(node)) {
+        rb_augment_update(tree, node);
+    }
+}
+
+static void rb_transplant(rb_tree_t *tree, rb_node_t *u, rb_node_t *v) {
+    if (rb_node_parent(u) == tree->nil) {
+        tree->root = v;
+    } else if (u == rb_node_parent(u)->left) {
+        rb_node_parent(u)->left = v;
+    } else {
+        rb_node_parent(u)->right = v;
+    }
+    rb_node_set_parent(v, rb_node_parent(u));
+}
+
+static void rb_delete_fixup(rb_tree_t *tree, rb_node_t *x) {
+    while (x != tree->root && rb_node_color(x) == RB_BLACK) {
+        if (x == rb_node_parent(x)->left) {
+            rb_node_t *w = rb_node_parent(x)->right;
+            if (rb_node_color(w) == RB_RED) {
+                rb_node_set_color(w, RB_BLACK);
+                rb_node_set_color(rb_node_parent(x), RB_RED);
+                rb_left_rotate(tree, rb_node_parent(x));
+                w = rb_node_parent(x)->right;
+            }
+            if (rb_node_color(w->left) == RB_BLACK && rb_node_color(w->right) == RB_BLACK) {
+                rb_node_set_color(w, RB_RED);
+                x = rb_node_parent(x);
+            } else {
+                if (rb_node_color(w->right) == RB_BLACK) {
+                    rb_node_set_color(w->left, RB_BLACK);
+                    rb_node_set_color(w, RB_RED);
+                    rb_right_rotate(tree, w);
+                    w = rb_node_parent(x)->right;
+                }
+                rb_node_set_color(w, rb_node_color(rb_node_parent(x)));
+                rb_node_set_color(rb_node_parent(x), RB_BLACK);
+                rb_node_set_color(w->right, RB_BLACK);
+                rb_left_rotate(tree, rb_node_parent(x));
+                x = tree->root;
+            }
+        } else {
+            rb_node_t *w = rb_node_parent(x)->left;
+            if (rb_node_color(w) == RB_RED) {
+                rb_node_set_color(w, RB_BLACK);
+                rb_node_set_color(rb_node_parent(x), RB_RED);
+                rb_right_rotate(tree, rb_node_parent(x));
+                w = rb_node_parent(x)->left;
+            }
+            if (rb_node_color(w->right) == RB_BLACK && rb_node_color(w->left) == RB_BLACK) {
+                rb_node_set_color(w, RB_RED);
+                x = rb_node_parent(x);
+            } else {
+                if (rb_node_color(w->left) == RB_BLACK) {
+                    rb_node_set_color(w->right, RB_BLACK);
+                    rb_node_set_color(w, RB_RED);
+                    rb_left_rotate(tree, w);
+                    w = rb_node_parent(x)->left;
+                }
+                rb_node_set_color(w, rb_node_color(rb_node_parent(x)));
+                rb_node_set_color(rb_node_parent(x), RB_BLACK);
+                rb_node_set_color(w->left, RB_BLACK);
+                rb_right_rotate(tree, rb_node_parent(x));
+                x = tree->root;
+            }
+        }
+    }
+    rb_node_set_color(x, RB_BLACK);
+}
+
+/* Specialised descent for scalar inline keys: no callback, no payload access */
+#define RB_FIND_SCALAR(type)                                        \
+    do {                                                            \
+        type k;                                                     \
+        memcpy(&k, data, sizeof(k));                                \
+        while (current != tree->nil) {                              \
+            type v = *(const type *)RB_INLINE_KEY(current);         \
+            if (k < v) {                                            \
+                current = current->left;                            \
+            } else if (k > v) {                                     \
+                current = current->right;                           \
+            } else {                                                \
+                return current;                                     \
+            }                                                       \
+        }                                                           \
+        return tree->nil;                                           \
+    } while (0)
+
+static rb_node_t *rb_find_node(rb_tree_t *tree, const void *data) {
+    rb_node_t *current = tree->root;
+    
+    switch (tree->key_type) {
+        case RB_KEY_INT64:
+            RB_FIND_SCALAR(int64_t);
+        case RB_KEY_UINT64:
+            RB_FIND_SCALAR(uint64_t);
+        case RB_KEY_DOUBLE:
+            RB_FIND_SCALAR(double);
+        case RB_KEY_STRING: {
+            /* Prefix the probe once; strcmp only on prefix ties */
+            uint64_t prefix = rb_string_prefix(data);
+            while (current != tree->nil) {
+                const rb_string_key_t *k = RB_STRING_KEY(current);
+                int cmp = (prefix != k->prefix) ? ((prefix > k->prefix) - (prefix < k->prefix))
+                                                : strcmp(data, k->str);
+                if (cmp < 0) {
+                    current = current->left;
+                } else if (cmp > 0) {
+                    current = current->right;
+                } else {
+                    return current;
+                }
+            }
+            return tree->nil;
+        }
+        default:
+            break;
+    }
+    
+    while (current != tree->nil) {
+        int cmp = rb_key_cmp(tree, data, current);
+        if (cmp < 0) {
+            current = current->left;
+        } else if (cmp > 0) {
+            current = current->right;
+        } else {
+            return current;
+        }
+    }
+    
+    return tree->nil;
+}
+
+/* Detach z from the tree and rebalance, leaving the node and its payload
+ * alone. Every removal path goes through here so that the cached extremes,
+ * the lookup cache and the filter see each unlinked node. */
+static void rb_unlink_node(rb_tree_t *tree, rb_node_t *z) {
+    if (z == tree->leftmost) {
+        tree->leftmost = rb_tree_successor_node(tree, z);
+    }
+    if (z == tree->rightmost) {
+        tree->rightmost = rb_tree_predecessor_node(tree, z);
+    }
+    
+    rb_node_t *y = z;
+    rb_node_t *x;
+    rb_node_t *shrunk = rb_node_parent(z);     /* Lowest node that lost a descendant */
+    rb_color_t y_original_color = rb_node_color(y);
+    
+    if (z->left == tree->nil) {
+        x = z->right;
+        rb_transplant(tree, z, z->right);
+    } else if (z->right == tree->nil) {
+        x = z->left;
+        rb_transplant(tree, z, z->left);
+    } else {
+        y = rb_tree_minimum_node(tree, z->right);
+        y_original_color = rb_node_color(y);
+        x = y->right;
+        if (rb_node_parent(y) == z) {
+            rb_node_set_parent(x, y);
+            shrunk = y;
+        } else {
+            shrunk = rb_node_parent(y);
+            rb_transplant(tree, y, y->right);
+            y->right = z->right;
+            rb_node_set_parent(y->right, y);
+        }
+        rb_transplant(tree, z, y);
+        y->left = z->left;
+        rb_node_set_parent(y->left, y);
+        rb_node_set_color(y, rb_node_color(z));
+    }
+    
+    /* Fix the path before the fixup rotations rely on it */
+    if (RB_AUGMENTED(tree)) {
+        rb_augment_propagate(tree, shrunk);
+    }
+    
+    if (y_original_color == RB_BLACK) {
+        rb_delete_fixup(tree, x);
+    }
+    
+    rb_cache_forget(tree, z);
+    rb_filter_update(tree, z, -1);
+    tree->size--;
+}
+
+rb_result_t rb_delete(rb_tree_t *tree, const void *data) {
+    if (!tree || !data) {
+        return RB_ERROR;
+    }
+    
+    if (tree->filter && !rb_filter_may_contain(tree, tree->hash(data))) {
+        return RB_NOT_FOUND;
+    }
+    
+    rb_node_t *z = rb_find_node(tree, data);
+    if (z == tree->nil) {
+        return RB_NOT_FOUND;
+    }
+    
+    rb_unlink_node(tree, z);
+    rb_node_destroy(tree, z);
+    
+    return RB_OK;
+}
+
+/* Unlink z and give its payload (and, for malloc'd nodes, the node itself)
+ * to the caller. Pooled nodes belong to the tree's slabs and are released. */
+static void *rb_detach_node(rb_tree_t *tree, rb_node_t *z, rb_node_t **node_out) {
+    rb_unlink_node(tree, z);
+    void *data = z->data;
+    if (tree->payload_size) {
+        tree->payload_bytes -= tree->payload_size(data);
+    }
+    
+    if (node_out && tree->alloc_mode == RB_ALLOC_MALLOC) {
+        tree->bytes_allocated -= RB_MALLOC_CHARGE(z, tree->node_size);
+        z->left = RB_LAYOUT_SIZE_TAG(tree);
+        z->right = RB_LAYOUT_KEY_TAG(tree);
+        *node_out = z;
+    } else {
+        rb_node_free(tree, z);
+    }
+    
+    return data;
+}
+
+void *rb_extract(rb_tree_t *tree, const void *key, rb_node_t **node_out) {
+    if (node_out) {
+        *node_out = NULL;
+    }
+    if (!tree || !key) {
+        return NULL;
+    }
+    
+    if (tree->filter && !rb_filter_may_contain(tree, tree->hash(key))) {
+        return NULL;
+    }
+    
+    rb_node_t *z = rb_find_node(tree, key);
+    if (z == tree->nil) {
+        return NULL;
+    }
+    
+    return rb_detach_node(tree, z, node_out);
+}
+
+/* Double-ended priority queue removal: the cached extreme is unlinked
+ * directly, without a key search */
+void *rb_pop_min(rb_tree_t *tree) {
+    if (!tree || tree->leftmost == tree->nil) {
+        return NULL;
+    }
+    
+    return rb_detach_node(tree, tree->leftmost, NULL);
+}
+
+void *rb_pop_max(rb_tree_t *tree) {
+    if (!tree || tree->rightmost == tree->nil) {
+        return NULL;
+    }
+    
+    return rb_detach_node(tree, tree->rightmost, NULL);
+}
+
+rb_result_t rb_insert_node(rb_tree_t *tree, rb_node_t *node) {
+    if (!tree || !node || !node->data || tree->alloc_mode != RB_ALLOC_MALLOC) {
+        return RB_ERROR;
+    }
+    if (node->left != RB_LAYOUT_SIZE_TAG(tree) || node->right != RB_LAYOUT_KEY_TAG(tree)) {
+        return RB_ERROR;
+    }
+    
+    rb_node_t *parent;
+    int cmp;
+    if (rb_find_slot(tree, rb_node_key(tree, node), &parent, &cmp) != tree->nil) {
+        return RB_DUPLICATE;
+    }
+    
+    size_t charge = RB_MALLOC_CHARGE(node, tree->node_size);
+    size_t payload = tree->payload_size ? tree->payload_size(node->data) : 0;
+    if (tree->memory_budget &&
+        tree->bytes_allocated + tree->payload_bytes + charge + payload > tree->memory_budget) {
+        return RB_MEMORY_ERROR;
+    }
+    tree->bytes_allocated += charge;
+    tree->payload_bytes += payload;
+    
+    rb_link_node(tree, parent, cmp, node);
+    return RB_OK;
+}
+
+void *rb_search(rb_tree_t *tree, const void *data) {
+    if (!tree || !data) {
+        return NULL;
+    }
+    
+    if (!tree->cache && !tree->filter) {
+        rb_node_t *node = rb_find_node(tree, data);
+        return (node != tree->nil) ? node->data : NULL;
+    }
     
-    while (x != tree->nil) {
-        y = x;
-        int cmp = tree->compare(data, x->data);
-        if (cmp < 0) {
-            x = x->left;
-        } else if (cmp > 0) {
-            x = x->right;
-        } else {
-            free(z);
-            return RB_DUPLICATE;
+    uint64_t hash = tree->hash(data);
+    struct rb_cache_entry *entry = NULL;
+    if (tree->cache) {
+        entry = &tree->cache[hash & tree->cache_mask];
+        if (entry->node && entry->hash == hash && rb_key_cmp(tree, data, entry->node) == 0) {
+            tree->cache_hits++;
+            return entry->node->data;
         }
+        tree->cache_misses++;
     }
     
-    z->parent = y;
-    if (y == tree->nil) {
-        tree->root = z;
-    } else if (tree->compare(data, y->data) < 0) {
-        y->left = z;
-    } else {
-        y->right = z;
+    /* Most absent keys stop here without touching a node */
+    if (tree->filter && !rb_filter_may_contain(tree, hash)) {
+        tree->filter_rejects++;
+        return NULL;
     }
     
-    rb_insert_fixup(tree, z);
-    tree->size++;
+    rb_node_t *node = rb_find_node(tree, data);
+    if (node == tree->nil) {
+        if (tree->filter) {
+            tree->filter_false_positives++;
+        }
+        return NULL;
+    }
     
-    return RB_OK;
-}
-
-static void rb_transplant(rb_tree_t *tree, rb_node_t *u, rb_node_t *v) {
-    if (u->parent == tree->nil) {
-        tree->root = v;
-    } else if (u == u->parent->left) {
-        u->parent->left = v;
-    } else {
-        u->parent->right = v;
+    if (entry) {
+        entry->hash = hash;
+        entry->node = node;
     }
-    v->parent = u->parent;
+    return node->data;
 }
 
-static void rb_delete_fixup(rb_tree_t *tree, rb_node_t *x) {
-    while (x != tree->root && x->color == RB_BLACK) {
-        if (x == x->parent->left) {
-            rb_node_t *w = x->parent->right;
-            if (w->color == RB_RED) {
-                w->color = RB_BLACK;
-                x->parent->color = RB_RED;
-                rb_left_rotate(tree, x->parent);
-                w = x->parent->right;
-            }
-            if (w->left->color == RB_BLACK && w->right->color == RB_BLACK) {
-                w->color = RB_RED;
-                x = x->parent;
+/* Batched lookup: keep a group of independent descents in flight and advance
+ * them round-robin, prefetching each next node so that the cache misses of
+ * different lookups overlap instead of forming one serial chain */
+#define RB_BATCH_GROUP 16
+
+#if defined(__GNUC__) || defined(__clang__)
+#define RB_PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define RB_PREFETCH(addr) ((void)(addr))
+#endif
+
+typedef struct {
+    rb_node_t *node;
+    size_t index;
+    bool loaded;    /* Generic trees: node arrived, payload prefetch issued */
+} rb_batch_slot_t;
+
+size_t rb_search_batch(rb_tree_t *tree, const void *const *keys, size_t n, void **results) {
+    if (!tree || (n > 0 && (!keys || !results))) {
+        return 0;
+    }
+    
+    rb_batch_slot_t slots[RB_BATCH_GROUP];
+    bool generic = (tree->key_type == RB_KEY_GENERIC);
+    size_t next = 0;
+    size_t active = 0;
+    size_t found = 0;
+    
+    while (active < RB_BATCH_GROUP && next < n) {
+        slots[active].node = tree->root;
+        slots[active].index = next++;
+        slots[active].loaded = false;
+        active++;
+    }
+    
+    while (active > 0) {
+        size_t i = 0;
+        while (i < active) {
+            rb_batch_slot_t *slot = &slots[i];
+            const void *key = keys[slot->index];
+            bool done = false;
+            
+            if (slot->node == tree->nil || !key) {
+                results[slot->index] = NULL;
+                done = true;
+            } else if (generic && !slot->loaded) {
+                /* The comparator dereferences the payload: fetch it first */
+                RB_PREFETCH(slot->node->data);
+                slot->loaded = true;
             } else {
-                if (w->right->color == RB_BLACK) {
-                    w->left->color = RB_BLACK;
-                    w->color = RB_RED;
-                    rb_right_rotate(tree, w);
-                    w = x->parent->right;
+                int cmp = rb_key_cmp(tree, key, slot->node);
+                if (cmp == 0) {
+                    results[slot->index] = slot->node->data;
+                    found++;
+                    done = true;
+                } else {
+                    slot->node = (cmp < 0) ? slot->node->left : slot->node->right;
+                    slot->loaded = false;
+                    RB_PREFETCH(slot->node);
                 }
-                w->color = x->parent->color;
-                x->parent->color = RB_BLACK;
-                w->right->color = RB_BLACK;
-                rb_left_rotate(tree, x->parent);
-                x = tree->root;
-            }
-        } else {
-            rb_node_t *w = x->parent->left;
-            if (w->color == RB_RED) {
-                w->color = RB_BLACK;
-                x->parent->color = RB_RED;
-                rb_right_rotate(tree, x->parent);
-                w = x->parent->left;
             }
-            if (w->right->color == RB_BLACK && w->left->color == RB_BLACK) {
-                w->color = RB_RED;
-                x = x->parent;
+            
+            if (!done) {
+                i++;
+            } else if (next < n) {
+                slot->node = tree->root;
+                slot->index = next++;
+                slot->loaded = false;
+                i++;
             } else {
-                if (w->left->color == RB_BLACK) {
-                    w->right->color = RB_BLACK;
-                    w->color = RB_RED;
-                    rb_left_rotate(tree, w);
-                    w = x->parent->left;
-                }
-                w->color = x->parent->color;
-                x->parent->color = RB_BLACK;
-                w->left->color = RB_BLACK;
-                rb_right_rotate(tree, x->parent);
-                x = tree->root;
+                /* Retire the slot; the moved-in one is advanced this round */
+                *slot = slots[--active];
             }
         }
     }
-    x->color = RB_BLACK;
+    
+    return found;
 }
 
-static rb_node_t *rb_find_node(rb_tree_t *tree, const void *data) {
-    rb_node_t *current = tree->root;
+/* Finger search for sorted batches: the subtree of a node spans the open
+ * interval between its nearest ancestor on the left and on the right. Every
+ * subtree on the path up contains the finger, so the bound on the finger's
+ * side of the key always holds and only the other one needs checking. Climb
+ * to the lowest ancestor whose interval contains the key and descend from
+ * there; nearby keys resolve a few levels up instead of at the root. */
+static rb_node_t *rb_finger_start(rb_tree_t *tree, rb_node_t *finger, const void *key) {
+    int side = rb_key_cmp(tree, key, finger);
+    if (side == 0) {
+        return finger;
+    }
     
-    while (current != tree->nil) {
-        int cmp = tree->compare(data, current->data);
-        if (cmp < 0) {
-            current = current->left;
-        } else if (cmp > 0) {
-            current = current->right;
-        } else {
-            return current;
+    rb_node_t *x = finger;
+    while (x != tree->root) {
+        rb_node_t *p = rb_node_parent(x);
+        bool bound = (side > 0) ? (x == p->left) : (x == p->right);
+        if (bound) {
+            int cmp = rb_key_cmp(tree, key, p);
+            if (cmp == 0) {
+                return p;
+            }
+            if ((side > 0 && cmp < 0) || (side < 0 && cmp > 0)) {
+                break;
+            }
         }
+        x = p;
     }
     
-    return tree->nil;
+    return x;
 }
 
-rb_result_t rb_delete(rb_tree_t *tree, const void *data) {
-    if (!tree || !data) {
-        return RB_ERROR;
+size_t rb_search_sorted(rb_tree_t *tree, const void *const *keys, size_t n, void **results) {
+    if (!tree || (n > 0 && (!keys || !results))) {
+        return 0;
     }
     
-    rb_node_t *z = rb_find_node(tree, data);
-    if (z == tree->nil) {
-        return RB_NOT_FOUND;
+    rb_node_t *finger = tree->root;
+    size_t found = 0;
+    
+    for (size_t i = 0; i < n; i++) {
+        results[i] = NULL;
+        if (!keys[i] || finger == tree->nil) {
+            continue;
+        }
+        
+        rb_node_t *x = rb_finger_start(tree, finger, keys[i]);
+        while (x != tree->nil) {
+            finger = x;
+            int cmp = rb_key_cmp(tree, keys[i], x);
+            if (cmp < 0) {
+                x = x->left;
+            } else if (cmp > 0) {
+                x = x->right;
+            } else {
+                results[i] = x->data;
+                found++;
+                break;
+            }
+        }
     }
     
-    rb_node_t *y = z;
-    rb_node_t *x;
-    rb_color_t y_original_color = y->color;
+    return found;
+}
+
+static rb_result_t rb_insert_sorted_keys(rb_tree_t *tree, const void *const *keys,
+                                         void *const *items, size_t n, size_t *inserted) {
+    rb_node_t *finger = tree->root;
+    size_t count = 0;
+    rb_result_t result = RB_OK;
     
-    if (z->left == tree->nil) {
-        x = z->right;
-        rb_transplant(tree, z, z->right);
-    } else if (z->right == tree->nil) {
-        x = z->left;
-        rb_transplant(tree, z, z->left);
-    } else {
-        y = rb_tree_minimum_node(tree, z->right);
-        y_original_color = y->color;
-        x = y->right;
-        if (y->parent == z) {
-            x->parent = y;
-        } else {
-            rb_transplant(tree, y, y->right);
-            y->right = z->right;
-            y->right->parent = y;
+    for (size_t i = 0; i < n; i++) {
+        if (!keys[i] || !items[i]) {
+            continue;
         }
-        rb_transplant(tree, z, y);
-        y->left = z->left;
-        y->left->parent = y;
-        y->color = z->color;
+        
+        rb_node_t *y = tree->nil;
+        rb_node_t *x = (finger == tree->nil) ? tree->root : rb_finger_start(tree, finger, keys[i]);
+        int cmp = 0;
+        while (x != tree->nil) {
+            y = x;
+            cmp = rb_key_cmp(tree, keys[i], x);
+            if (cmp < 0) {
+                x = x->left;
+            } else if (cmp > 0) {
+                x = x->right;
+            } else {
+                break;
+            }
+        }
+        
+        /* Duplicates are skipped; the matching node becomes the finger */
+        if (x != tree->nil) {
+            finger = x;
+            continue;
+        }
+        
+        /* Descending from an inner node still ends at the unique leaf slot
+         * for the key, so linking below y keeps the order intact */
+        result = rb_link_new_node(tree, y, cmp, keys[i], items[i], &finger);
+        if (result != RB_OK) {
+            break;
+        }
+        count++;
     }
     
-    if (y_original_color == RB_BLACK) {
-        rb_delete_fixup(tree, x);
+    if (inserted) {
+        *inserted = count;
+    }
+    return result;
+}
+
+rb_result_t rb_insert_sorted(rb_tree_t *tree, void *const *items, size_t n, size_t *inserted) {
+    if (inserted) {
+        *inserted = 0;
+    }
+    if (!tree || (n > 0 && !items) || tree->key_type != RB_KEY_GENERIC) {
+        return RB_ERROR;
     }
     
-    rb_node_destroy(tree, z);
-    tree->size--;
-    
-    return RB_OK;
+    return rb_insert_sorted_keys(tree, (const void *const *)items, items, n, inserted);
 }
 
-void *rb_search(rb_tree_t *tree, const void *data) {
-    if (!tree || !data) {
-        return NULL;
+rb_result_t rb_insert_key_sorted(rb_tree_t *tree, const void *const *keys, void *const *items,
+                                 size_t n, size_t *inserted) {
+    if (inserted) {
+        *inserted = 0;
+    }
+    if (!tree || (n > 0 && (!keys || !items)) || tree->key_type == RB_KEY_GENERIC) {
+        return RB_ERROR;
     }
     
-    rb_node_t *node = rb_find_node(tree, data);
-    return (node != tree->nil) ? node->data : NULL;
+    return rb_insert_sorted_keys(tree, keys, items, n, inserted);
 }
 
 static rb_node_t *rb_tree_minimum_node(rb_tree_t *tree, rb_node_t *node) {
@@ -395,8 +2035,7 @@ void *rb_min(rb_tree_t *tree) {
         return NULL;
     }
     
-    rb_node_t *node = rb_tree_minimum_node(tree, tree->root);
-    return node->data;
+    return tree->leftmost->data;
 }
 
 void *rb_max(rb_tree_t *tree) {
@@ -404,8 +2043,7 @@ void *rb_max(rb_tree_t *tree) {
         return NULL;
     }
     
-    rb_node_t *node = rb_tree_maximum_node(tree, tree->root);
-    return node->data;
+    return tree->rightmost->data;
 }
 
 static rb_node_t *rb_tree_successor_node(rb_tree_t *tree, rb_node_t *node) {
@@ -413,10 +2051,10 @@ static rb_node_t *rb_tree_successor_node(rb_tree_t *tree, rb_node_t *node) {
         return rb_tree_minimum_node(tree, node->right);
     }
     
-    rb_node_t *y = node->parent;
+    rb_node_t *y = rb_node_parent(node);
     while (y != tree->nil && node == y->right) {
         node = y;
-        y = y->parent;
+        y = rb_node_parent(y);
     }
     return y;
 }
@@ -426,10 +2064,10 @@ static rb_node_t *rb_tree_predecessor_node(rb_tree_t *tree, rb_node_t *node) {
         return rb_tree_maximum_node(tree, node->left);
     }
     
-    rb_node_t *y = node->parent;
+    rb_node_t *y = rb_node_parent(node);
     while (y != tree->nil && node == y->left) {
         node = y;
-        y = y->parent;
+        y = rb_node_parent(y);
     }
     return y;
 }
@@ -462,6 +2100,283 @@ void *rb_predecessor(rb_tree_t *tree, const void *data) {
     return (pred != tree->nil) ? pred->data : NULL;
 }
 
+/* Closest node on one side of a key in a single descent: upward finds the
+ * smallest node above key, otherwise the largest node below it; inclusive
+ * also accepts an equal node */
+static rb_node_t *rb_bound_node(rb_tree_t *tree, const void *key, bool upward, bool inclusive) {
+    rb_node_t *best = tree->nil;
+    rb_node_t *x = tree->root;
+    
+    while (x != tree->nil) {
+        int cmp = rb_key_cmp(tree, key, x);
+        if (cmp == 0 && inclusive) {
+            return x;
+        }
+        if (upward ? cmp < 0 : cmp > 0) {
+            best = x;
+            x = upward ? x->left : x->right;
+        } else {
+            x = upward ? x->right : x->left;
+        }
+    }
+    
+    return best;
+}
+
+rb_node_t *rb_lower_bound_node(rb_tree_t *tree, const void *key) {
+    if (!tree || !key) {
+        return NULL;
+    }
+    
+    rb_node_t *node = rb_bound_node(tree, key, true, true);
+    return (node != tree->nil) ? node : NULL;
+}
+
+rb_node_t *rb_upper_bound_node(rb_tree_t *tree, const void *key) {
+    if (!tree || !key) {
+        return NULL;
+    }
+    
+    rb_node_t *node = rb_bound_node(tree, key, true, false);
+    return (node != tree->nil) ? node : NULL;
+}
+
+rb_node_t *rb_floor_node(rb_tree_t *tree, const void *key) {
+    if (!tree || !key) {
+        return NULL;
+    }
+    
+    rb_node_t *node = rb_bound_node(tree, key, false, true);
+    return (node != tree->nil) ? node : NULL;
+}
+
+rb_node_t *rb_ceiling_node(rb_tree_t *tree, const void *key) {
+    return rb_lower_bound_node(tree, key);
+}
+
+rb_node_t *rb_min_node(rb_tree_t *tree) {
+    if (!tree || tree->root == tree->nil) {
+        return NULL;
+    }
+    
+    return tree->leftmost;
+}
+
+rb_node_t *rb_max_node(rb_tree_t *tree) {
+    if (!tree || tree->root == tree->nil) {
+        return NULL;
+    }
+    
+    return tree->rightmost;
+}
+
+rb_node_t *rb_next_node(rb_tree_t *tree, rb_node_t *node) {
+    if (!tree || !node || node == tree->nil) {
+        return NULL;
+    }
+    
+    rb_node_t *next = rb_tree_successor_node(tree, node);
+    return (next != tree->nil) ? next : NULL;
+}
+
+rb_node_t *rb_prev_node(rb_tree_t *tree, rb_node_t *node) {
+    if (!tree || !node || node == tree->nil) {
+        return NULL;
+    }
+    
+    rb_node_t *prev = rb_tree_predecessor_node(tree, node);
+    return (prev != tree->nil) ? prev : NULL;
+}
+
+void *rb_lower_bound(rb_tree_t *tree, const void *key) {
+    rb_node_t *node = rb_lower_bound_node(tree, key);
+    return node ? node->data : NULL;
+}
+
+void *rb_upper_bound(rb_tree_t *tree, const void *key) {
+    rb_node_t *node = rb_upper_bound_node(tree, key);
+    return node ? node->data : NULL;
+}
+
+void *rb_floor(rb_tree_t *tree, const void *key) {
+    rb_node_t *node = rb_floor_node(tree, key);
+    return node ? node->data : NULL;
+}
+
+void *rb_ceiling(rb_tree_t *tree, const void *key) {
+    return rb_lower_bound(tree, key);
+}
+
+size_t rb_rank(rb_tree_t *tree, const void *key) {
+    if (!tree || !key) {
+        return 0;
+    }
+    
+    if (!tree->count_offset) {
+        return rb_node_rank(tree, rb_lower_bound_node(tree, key));
+    }
+    
+    /* Every left turn's skipped subtree, plus the node itself, is smaller */
+    size_t rank = 0;
+    rb_node_t *node = tree->root;
+    while (node != tree->nil) {
+        if (rb_compare_key(tree, key, node) <= 0) {
+            node = node->left;
+        } else {
+            rank += RB_SUBTREE_COUNT(tree, node->left) + 1;
+            node = node->right;
+        }
+    }
+    
+    return rank;
+}
+
+size_t rb_node_rank(rb_tree_t *tree, rb_node_t *node) {
+    if (!tree) {
+        return 0;
+    }
+    if (!node || node == tree->nil) {
+        return tree->size;
+    }
+    
+    size_t rank = 0;
+    if (!tree->count_offset) {
+        while (node != tree->leftmost) {
+            node = rb_tree_predecessor_node(tree, node);
+            rank++;
+        }
+        return rank;
+    }
+    
+    /* Climbing out of a right child passes the parent and its left subtree */
+    rank = RB_SUBTREE_COUNT(tree, node->left);
+    while (node != tree->root) {
+        rb_node_t *parent = rb_node_parent(node);
+        if (node == parent->right) {
+            rank += RB_SUBTREE_COUNT(tree, parent->left) + 1;
+        }
+        node = parent;
+    }
+    
+    return rank;
+}
+
+rb_node_t *rb_select_node(rb_tree_t *tree, size_t index) {
+    if (!tree || index >= tree->size) {
+        return NULL;
+    }
+    
+    rb_node_t *node;
+    if (!tree->count_offset) {
+        node = tree->leftmost;
+        while (index-- > 0) {
+            node = rb_tree_successor_node(tree, node);
+        }
+        return node;
+    }
+    
+    node = tree->root;
+    for (;;) {
+        size_t left = RB_SUBTREE_COUNT(tree, node->left);
+        if (index < left) {
+            node = node->left;
+        } else if (index > left) {
+            index -= left + 1;
+            node = node->right;
+        } else {
+            return node;
+        }
+    }
+}
+
+void *rb_select(rb_tree_t *tree, size_t index) {
+    rb_node_t *node = rb_select_node(tree, index);
+    return node ? node->data : NULL;
+}
+
+/* Fold the elements >= lo of a subtree into acc, in order. The pieces are
+ * found right to left, so the left side recurses (depth <= height). */
+static void rb_aggregate_from(rb_tree_t *tree, rb_node_t *node, const void *lo, void *acc) {
+    while (node != tree->nil && rb_compare_key(tree, lo, node) > 0) {
+        node = node->right;
+    }
+    if (node == tree->nil) {
+        return;
+    }
+    
+    rb_aggregate_from(tree, node->left, lo, acc);
+    tree->augment.value(tree->augment_scratch, node->data);
+    tree->augment.combine(acc, tree->augment_scratch);
+    tree->augment.combine(acc, RB_AGGREGATE(tree, node->right));
+}
+
+/* Fold the elements <= hi of a subtree into acc, left to right */
+static void rb_aggregate_upto(rb_tree_t *tree, rb_node_t *node, const void *hi, void *acc) {
+    while (node != tree->nil) {
+        if (rb_compare_key(tree, hi, node) < 0) {
+            node = node->left;
+        } else {
+            tree->augment.combine(acc, RB_AGGREGATE(tree, node->left));
+            tree->augment.value(tree->augment_scratch, node->data);
+            tree->augment.combine(acc, tree->augment_scratch);
+            node = node->right;
+        }
+    }
+}
+
+rb_result_t rb_aggregate_range(rb_tree_t *tree, const void *lo, const void *hi, void *out) {
+    if (!tree || !out || !tree->aggregate_offset) {
+        return RB_ERROR;
+    }
+    
+    memcpy(out, RB_AGGREGATE(tree, tree->nil), tree->augment.size);
+    
+    /* Descend to the topmost node inside the range; everything in range is
+     * below it, split by it into a left and a right boundary path */
+    rb_node_t *node = tree->root;
+    while (node != tree->nil) {
+        if (lo && rb_compare_key(tree, lo, node) > 0) {
+            node = node->right;
+        } else if (hi && rb_compare_key(tree, hi, node) < 0) {
+            node = node->left;
+        } else {
+            break;
+        }
+    }
+    if (node == tree->nil) {
+        return RB_OK;
+    }
+    
+    if (lo) {
+        rb_aggregate_from(tree, node->left, lo, out);
+    } else {
+        tree->augment.combine(out, RB_AGGREGATE(tree, node->left));
+    }
+    tree->augment.value(tree->augment_scratch, node->data);
+    tree->augment.combine(out, tree->augment_scratch);
+    if (hi) {
+        rb_aggregate_upto(tree, node->right, hi, out);
+    } else {
+        tree->augment.combine(out, RB_AGGREGATE(tree, node->right));
+    }
+    
+    return RB_OK;
+}
+
+rb_result_t rb_aggregate_refresh(rb_tree_t *tree, const void *key) {
+    if (!tree || !key || !tree->aggregate_offset) {
+        return RB_ERROR;
+    }
+    
+    rb_node_t *node = rb_find_node(tree, key);
+    if (node == tree->nil) {
+        return RB_NOT_FOUND;
+    }
+    
+    rb_augment_propagate(tree, node);
+    return RB_OK;
+}
+
 static void rb_inorder_walk_node(rb_tree_t *tree, rb_node_t *node, rb_visit_func_t visit, void *context) {
     if (node != tree->nil) {
         rb_inorder_walk_node(tree, node->left, visit, context);
@@ -536,8 +2451,8 @@ static bool rb_is_valid_node(rb_tree_t *tree, rb_node_t *node, int *black_height
         return true;
     }
     
-    if (node->color == RB_RED) {
-        if (node->left->color != RB_BLACK || node->right->color != RB_BLACK) {
+    if (rb_node_color(node) == RB_RED) {
+        if (rb_node_color(node->left) != RB_BLACK || rb_node_color(node->right) != RB_BLACK) {
             return false;
         }
     }
@@ -552,7 +2467,13 @@ static bool rb_is_valid_node(rb_tree_t *tree, rb_node_t *node, int *black_height
         return false;
     }
     
-    *black_height = left_black_height + (node->color == RB_BLACK ? 1 : 0);
+    if (tree->count_offset &&
+        RB_SUBTREE_COUNT(tree, node) != RB_SUBTREE_COUNT(tree, node->left) +
+                                        RB_SUBTREE_COUNT(tree, node->right) + 1) {
+        return false;
+    }
+    
+    *black_height = left_black_height + (rb_node_color(node) == RB_BLACK ? 1 : 0);
     return true;
 }
 
@@ -561,7 +2482,18 @@ bool rb_is_valid(rb_tree_t *tree) {
         return false;
     }
     
-    if (tree->root != tree->nil && tree->root->color != RB_BLACK) {
+    if (tree->root != tree->nil && rb_node_color(tree->root) != RB_BLACK) {
+        return false;
+    }
+    
+    rb_node_t *min = (tree->root != tree->nil) ? rb_tree_minimum_node(tree, tree->root) : tree->nil;
+    rb_node_t *max = (tree->root != tree->nil) ? rb_tree_maximum_node(tree, tree->root) : tree->nil;
+    if (tree->leftmost != min || tree->rightmost != max) {
+        return false;
+    }
+    
+    if (tree->count_offset && (RB_SUBTREE_COUNT(tree, tree->nil) != 0 ||
+                               RB_SUBTREE_COUNT(tree, tree->root) != tree->size)) {
         return false;
     }
     
@@ -3,6 +3,7 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 typedef enum {
     RB_RED = 0,
@@ -17,6 +18,26 @@ typedef enum {
     RB_MEMORY_ERROR = -4
 } rb_result_t;
 
+#ifdef RB_COMPACT_NODES
+/* Compact layout: the color is stored in the low bit of the parent pointer,
+ * which is always clear because nodes are at least pointer aligned */
+typedef struct rb_node {
+    void *data;
+    struct rb_node *left;
+    struct rb_node *right;
+    uintptr_t parent_color;
+} rb_node_t;
+
+#define RB_NODE_LAYOUT "compact"
+#define rb_node_parent(n) ((rb_node_t *)((n)->parent_color & ~(uintptr_t)1))
+#define rb_node_color(n) ((rb_color_t)((n)->parent_color & 1))
+#define rb_node_set_parent(n, p) \
+    ((n)->parent_color = (uintptr_t)(p) | ((n)->parent_color & 1))
+#define rb_node_set_color(n, c) \
+    ((n)->parent_color = ((n)->parent_color & ~(uintptr_t)1) | (uintptr_t)(c))
+#define rb_node_set_parent_color(n, p, c) \
+    ((n)->parent_color = (uintptr_t)(p) | (uintptr_t)(c))
+#else
 typedef struct rb_node {
     void *data;
     struct rb_node *left;
@@ -25,9 +46,81 @@ typedef struct rb_node {
     rb_color_t color;
 } rb_node_t;
 
+#define RB_NODE_LAYOUT "standard"
+#define rb_node_parent(n) ((n)->parent)
+#define rb_node_color(n) ((n)->color)
+#define rb_node_set_parent(n, p) ((n)->parent = (p))
+#define rb_node_set_color(n, c) ((n)->color = (c))
+#define rb_node_set_parent_color(n, p, c) ((n)->parent = (p), (n)->color = (c))
+#endif
+
+/* Recover the user record from an embedded node (intrusive trees) */
+#define RB_ENTRY(ptr, type, member) \
+    ((type *)((char *)(ptr) - offsetof(type, member)))
+
+typedef enum {
+    RB_ALLOC_MALLOC = 0,    /* One malloc/free per node (default) */
+    RB_ALLOC_POOL = 1,      /* Per-tree slab allocator with node free list */
+    RB_ALLOC_INTRUSIVE = 2, /* Nodes are embedded in the user records */
+    RB_ALLOC_ARENA = 3,     /* Tree and nodes live in a caller-supplied rb_arena_t */
+    RB_ALLOC_HUGEPAGE = 4   /* Slab chunks are 2 MB-aligned mmap regions backed by huge pages */
+} rb_alloc_mode_t;
+
+typedef enum {
+    RB_KEY_GENERIC = 0,     /* Keys live in the payload, compared by callback */
+    RB_KEY_INT64 = 1,       /* Inline int64_t keys */
+    RB_KEY_UINT64 = 2,      /* Inline uint64_t keys */
+    RB_KEY_DOUBLE = 3,      /* Inline double keys (NaN is not supported) */
+    RB_KEY_BYTES = 4,       /* Inline fixed-size blobs compared with memcmp */
+    RB_KEY_STRING = 5       /* NUL-terminated strings; 8-byte prefix cached in the node */
+} rb_key_type_t;
+
+typedef enum {
+    RB_LAYOUT_VEB = 0,      /* van Emde Boas (recursive top/bottom split) order */
+    RB_LAYOUT_BFS = 1,      /* Breadth-first (level) order */
+    RB_LAYOUT_DFS = 2       /* Depth-first (preorder) order */
+} rb_layout_t;
+
 typedef int (*rb_compare_func_t)(const void *a, const void *b);
 typedef void (*rb_visit_func_t)(void *data, void *context);
 typedef void (*rb_free_func_t)(void *data);
+typedef size_t (*rb_size_func_t)(const void *data);
+typedef uint64_t (*rb_hash_func_t)(const void *key);
+typedef void *(*rb_construct_func_t)(const void *key, void *context);
+typedef void (*rb_value_func_t)(void *out, const void *data);
+typedef void (*rb_combine_func_t)(void *acc, const void *next);
+
+/* Subtree aggregate kept in every node: combine(left, value(node), right).
+ * combine must be associative; it need not be commutative. */
+typedef struct {
+    size_t size;                /* Bytes per aggregate (0 = off) */
+    const void *identity;       /* Aggregate of an empty subtree */
+    rb_value_func_t value;      /* Aggregate of a single payload */
+    rb_combine_func_t combine;  /* acc = acc followed by next */
+} rb_augment_t;
+
+struct rb_arena;
+
+/* Optional creation parameters; zero-initialise and set the fields you need */
+typedef struct {
+    rb_alloc_mode_t alloc_mode;
+    size_t pool_chunk_nodes;    /* Nodes carved per slab chunk (0 = default) */
+    size_t node_offset;         /* offsetof(record, rb_node_t member), intrusive only */
+    rb_key_type_t key_type;     /* Inline key type (RB_KEY_GENERIC = use callback) */
+    size_t key_size;            /* Key length in bytes, RB_KEY_BYTES only */
+    struct rb_arena *arena;     /* Backing arena, RB_ALLOC_ARENA only */
+    rb_size_func_t payload_size; /* Bytes owned by a payload (NULL = not counted) */
+    size_t memory_budget;       /* Cap on node + payload bytes (0 = unlimited) */
+    rb_hash_func_t hash;        /* Key hash for the lookup cache */
+    size_t lookup_cache_slots;  /* Direct-mapped rb_search cache size (0 = off) */
+    size_t filter_capacity;     /* Expected keys for the counting Bloom filter (0 = off) */
+    bool order_statistics;      /* Keep subtree sizes for O(log n) rank/select (not intrusive) */
+    rb_augment_t augment;       /* Per-node subtree aggregate (not intrusive) */
+} rb_tree_config_t;
+
+struct rb_cache_entry;
+
+struct rb_pool_chunk;
 
 typedef struct rb_tree {
     rb_node_t *root;
@@ -35,20 +128,122 @@ typedef struct rb_tree {
     size_t size;
     rb_compare_func_t compare;
     rb_free_func_t free_data;
+    rb_alloc_mode_t alloc_mode;
+    size_t node_size;
+    size_t node_offset;
+    rb_key_type_t key_type;
+    size_t key_size;
+    struct rb_arena *arena;
+    /* Slab allocator state (RB_ALLOC_POOL and RB_ALLOC_ARENA) */
+    struct rb_pool_chunk *pool_chunks;
+    struct rb_pool_chunk *pool_spare; /* Emptied arena chunks awaiting reuse */
+    rb_node_t *pool_free_list;
+    size_t pool_free_count;
+    char *pool_bump;
+    char *pool_bump_end;
+    size_t pool_chunk_nodes;
+    /* Memory accounting */
+    rb_size_func_t payload_size;
+    size_t bytes_allocated;     /* Allocator-level bytes owned by the tree */
+    size_t bytes_hugepage;      /* Part of bytes_allocated advised as huge pages */
+    size_t payload_bytes;       /* Sum of payload_size over stored payloads */
+    size_t memory_budget;
+    /* Hot-key lookup cache (rb_search only) */
+    rb_hash_func_t hash;
+    struct rb_cache_entry *cache;
+    size_t cache_mask;
+    uint64_t cache_hits;
+    uint64_t cache_misses;
+    /* Counting Bloom filter in front of rb_search and rb_delete */
+    uint8_t *filter;            /* 64-byte blocks of 4-bit counters */
+    void *filter_block;         /* Allocation behind filter (cache line aligned) */
+    size_t filter_blocks;
+    uint64_t filter_rejects;    /* Absent keys answered by the filter alone */
+    uint64_t filter_false_positives; /* Absent keys the filter let through */
+    rb_node_t *leftmost;        /* Smallest node (nil when empty) */
+    rb_node_t *rightmost;       /* Largest node (nil when empty), for O(1) appends */
+    size_t count_offset;        /* Subtree size position in each node (0 = not kept) */
+    size_t aggregate_offset;    /* Subtree aggregate position in each node (0 = not kept) */
+    rb_augment_t augment;
+    void *augment_scratch;      /* One aggregate of working space */
 } rb_tree_t;
 
 rb_tree_t *rb_tree_create(rb_compare_func_t compare_func, rb_free_func_t free_func);
+rb_tree_t *rb_tree_create_ex(rb_compare_func_t compare_func, rb_free_func_t free_func,
+                             const rb_tree_config_t *config);
+rb_tree_t *rb_tree_create_intrusive(rb_compare_func_t compare_func, rb_free_func_t free_func,
+                                    size_t node_offset);
+rb_tree_t *rb_tree_create_keyed(rb_key_type_t key_type, size_t key_size, rb_free_func_t free_func);
 void rb_tree_destroy(rb_tree_t *tree);
+void rb_tree_clear(rb_tree_t *tree);
+rb_result_t rb_tree_reserve(rb_tree_t *tree, size_t capacity);
+size_t rb_tree_capacity(rb_tree_t *tree);
+/* Compaction moves malloc trees to pooled storage for good: rb_extract then
+ * releases nodes instead of handing them out, and rb_insert_node refuses them */
+rb_result_t rb_tree_compact(rb_tree_t *tree, rb_layout_t layout);
+size_t rb_tree_bytes_allocated(rb_tree_t *tree);
+size_t rb_tree_payload_bytes(rb_tree_t *tree);
+size_t rb_tree_hugepage_bytes(rb_tree_t *tree);
+size_t rb_tree_filter_bytes(rb_tree_t *tree);
+rb_result_t rb_tree_set_memory_budget(rb_tree_t *tree, size_t bytes);
 
 rb_result_t rb_insert(rb_tree_t *tree, void *data);
+rb_result_t rb_insert_key(rb_tree_t *tree, const void *key, void *data);
+rb_result_t rb_insert_hint(rb_tree_t *tree, rb_node_t *hint, void *data);
+rb_result_t rb_insert_key_hint(rb_tree_t *tree, rb_node_t *hint, const void *key, void *data);
+void *rb_insert_or_get(rb_tree_t *tree, void *data);
+void *rb_insert_key_or_get(rb_tree_t *tree, const void *key, void *data);
+rb_result_t rb_upsert(rb_tree_t *tree, void *data, void **replaced);
+rb_result_t rb_upsert_key(rb_tree_t *tree, const void *key, void *data, void **replaced);
+rb_result_t rb_emplace(rb_tree_t *tree, const void *key, rb_construct_func_t construct,
+                       void *context, void **element);
+rb_result_t rb_insert_sorted(rb_tree_t *tree, void *const *items, size_t n, size_t *inserted);
+rb_result_t rb_insert_key_sorted(rb_tree_t *tree, const void *const *keys, void *const *items,
+                                 size_t n, size_t *inserted);
 rb_result_t rb_delete(rb_tree_t *tree, const void *data);
+void *rb_extract(rb_tree_t *tree, const void *key, rb_node_t **node_out);
+rb_result_t rb_insert_node(rb_tree_t *tree, rb_node_t *node);
 void *rb_search(rb_tree_t *tree, const void *data);
+size_t rb_search_batch(rb_tree_t *tree, const void *const *keys, size_t n, void **results);
+size_t rb_search_sorted(rb_tree_t *tree, const void *const *keys, size_t n, void **results);
 
 void *rb_min(rb_tree_t *tree);
 void *rb_max(rb_tree_t *tree);
+void *rb_pop_min(rb_tree_t *tree);
+void *rb_pop_max(rb_tree_t *tree);
 void *rb_successor(rb_tree_t *tree, const void *data);
 void *rb_predecessor(rb_tree_t *tree, const void *data);
 
+/* Bound queries: one descent each; the probe need not be in the tree */
+void *rb_lower_bound(rb_tree_t *tree, const void *key);   /* First element >= key */
+void *rb_upper_bound(rb_tree_t *tree, const void *key);   /* First element > key */
+void *rb_floor(rb_tree_t *tree, const void *key);         /* Last element <= key */
+void *rb_ceiling(rb_tree_t *tree, const void *key);       /* First element >= key */
+
+/* Node cursors: start a scan at a bound and step with rb_next_node /
+ * rb_prev_node (NULL past either end); node->data is the element */
+rb_node_t *rb_lower_bound_node(rb_tree_t *tree, const void *key);
+rb_node_t *rb_upper_bound_node(rb_tree_t *tree, const void *key);
+rb_node_t *rb_floor_node(rb_tree_t *tree, const void *key);
+rb_node_t *rb_ceiling_node(rb_tree_t *tree, const void *key);
+rb_node_t *rb_min_node(rb_tree_t *tree);
+rb_node_t *rb_max_node(rb_tree_t *tree);
+rb_node_t *rb_next_node(rb_tree_t *tree, rb_node_t *node);
+rb_node_t *rb_prev_node(rb_tree_t *tree, rb_node_t *node);
+
+/* Order statistics: O(log n) on trees created with order_statistics,
+ * otherwise a walk from the minimum. Ranks count from 0. */
+size_t rb_rank(rb_tree_t *tree, const void *key);         /* Elements < key */
+size_t rb_node_rank(rb_tree_t *tree, rb_node_t *node);    /* NULL ranks as rb_size */
+void *rb_select(rb_tree_t *tree, size_t index);           /* index-th smallest element */
+rb_node_t *rb_select_node(rb_tree_t *tree, size_t index);
+
+/* Subtree aggregates (config.augment): fold [lo, hi] in O(log n); NULL
+ * bounds are open. Refresh after changing a payload's aggregated fields
+ * in place. */
+rb_result_t rb_aggregate_range(rb_tree_t *tree, const void *lo, const void *hi, void *out);
+rb_result_t rb_aggregate_refresh(rb_tree_t *tree, const void *key);
+
 void rb_inorder_walk(rb_tree_t *tree, rb_visit_func_t visit, void *context);
 void rb_preorder_walk(rb_tree_t *tree, rb_visit_func_t visit, void *context);
 void rb_postorder_walk(rb_tree_t *tree, rb_visit_func_t visit, void *context);
@@ -58,6 +253,9 @@ int rb_height(rb_tree_t *tree);
 bool rb_is_valid(rb_tree_t *tree);
 bool rb_is_empty(rb_tree_t *tree);
 
+const void *rb_node_key(const rb_tree_t *tree, const rb_node_t *node);
+int rb_compare_key(const rb_tree_t *tree, const void *key, const rb_node_t *node);
+
 void rb_print_tree(rb_tree_t *tree, void (*print_data)(const void *data));
 
 #endif /* RBTREE_H */
\ No newline at end of file
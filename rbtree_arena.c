@@ -0,0 +1,104 @@
+#include "rbtree_arena.h"
+#include <stdlib.h>
+
+#define RB_ARENA_DEFAULT_CHUNK_SIZE (256 * 1024)
+#define RB_ARENA_ALIGN 16
+
+struct rb_arena_chunk {
+    struct rb_arena_chunk *next;
+    size_t size;
+};
+
+/* Keep the usable area aligned like malloc's own results */
+#define RB_ARENA_HEADER \
+    ((sizeof(struct rb_arena_chunk) + RB_ARENA_ALIGN - 1) & ~(size_t)(RB_ARENA_ALIGN - 1))
+
+static int rb_arena_grow(rb_arena_t *arena, size_t min_size);
+
+rb_arena_t *rb_arena_create(size_t chunk_size) {
+    rb_arena_t *arena = malloc(sizeof(rb_arena_t));
+    if (!arena) {
+        return NULL;
+    }
+    
+    arena->chunks = NULL;
+    arena->cursor = NULL;
+    arena->limit = NULL;
+    arena->chunk_size = chunk_size ? chunk_size : RB_ARENA_DEFAULT_CHUNK_SIZE;
+    arena->bytes_reserved = 0;
+    
+    return arena;
+}
+
+void rb_arena_destroy(rb_arena_t *arena) {
+    if (!arena) {
+        return;
+    }
+    
+    struct rb_arena_chunk *chunk = arena->chunks;
+    while (chunk) {
+        struct rb_arena_chunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    
+    free(arena);
+}
+
+void rb_arena_reset(rb_arena_t *arena) {
+    if (!arena || !arena->chunks) {
+        return;
+    }
+    
+    /* Keep the newest chunk so the next request starts without a malloc */
+    struct rb_arena_chunk *keep = arena->chunks;
+    struct rb_arena_chunk *chunk = keep->next;
+    while (chunk) {
+        struct rb_arena_chunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    
+    keep->next = NULL;
+    arena->chunks = keep;
+    arena->cursor = (char *)keep + RB_ARENA_HEADER;
+    arena->limit = arena->cursor + keep->size;
+    arena->bytes_reserved = RB_ARENA_HEADER + keep->size;
+}
+
+static int rb_arena_grow(rb_arena_t *arena, size_t min_size) {
+    size_t size = min_size > arena->chunk_size ? min_size : arena->chunk_size;
+    
+    struct rb_arena_chunk *chunk = malloc(RB_ARENA_HEADER + size);
+    if (!chunk) {
+        return -1;
+    }
+    
+    chunk->next = arena->chunks;
+    chunk->size = size;
+    arena->chunks = chunk;
+    arena->cursor = (char *)chunk + RB_ARENA_HEADER;
+    arena->limit = arena->cursor + size;
+    arena->bytes_reserved += RB_ARENA_HEADER + size;
+    
+    return 0;
+}
+
+void *rb_arena_alloc(rb_arena_t *arena, size_t size) {
+    if (!arena || size == 0) {
+        return NULL;
+    }
+    
+    size = (size + RB_ARENA_ALIGN - 1) & ~(size_t)(RB_ARENA_ALIGN - 1);
+    if ((size_t)(arena->limit - arena->cursor) < size && rb_arena_grow(arena, size) != 0) {
+        return NULL;
+    }
+    
+    void *ptr = arena->cursor;
+    arena->cursor += size;
+    return ptr;
+}
+
+size_t rb_arena_bytes_reserved(const rb_arena_t *arena) {
+    return arena ? arena->bytes_reserved : 0;
+}
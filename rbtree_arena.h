@@ -0,0 +1,25 @@
+#ifndef RBTREE_ARENA_H
+#define RBTREE_ARENA_H
+
+#include <stddef.h>
+
+/* Bump-pointer arena for request-scoped trees. Allocations are never freed
+ * individually; rb_arena_reset/rb_arena_destroy release everything at once. */
+
+struct rb_arena_chunk;
+
+typedef struct rb_arena {
+    struct rb_arena_chunk *chunks;
+    char *cursor;
+    char *limit;
+    size_t chunk_size;
+    size_t bytes_reserved;
+} rb_arena_t;
+
+rb_arena_t *rb_arena_create(size_t chunk_size);
+void rb_arena_destroy(rb_arena_t *arena);
+void rb_arena_reset(rb_arena_t *arena);
+void *rb_arena_alloc(rb_arena_t *arena, size_t size);
+size_t rb_arena_bytes_reserved(const rb_arena_t *arena);
+
+#endif /* RBTREE_ARENA_H */
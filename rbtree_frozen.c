@@ -0,0 +1,527 @@
+#include "rbtree_frozen.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#if defined(__AVX2__) || defined(__SSE4_2__)
+#include <immintrin.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define RB_PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define RB_PREFETCH(addr) ((void)(addr))
+#endif
+
+#define RB_FROZEN_CACHE_LINE 64
+
+static size_t rb_frozen_bound(const rb_frozen_t *frozen, const void *key, int strict);
+static int rb_frozen_cmp(const rb_frozen_t *frozen, const void *key, size_t i);
+static size_t rb_frozen_first(const rb_frozen_t *frozen);
+static size_t rb_frozen_last(const rb_frozen_t *frozen);
+static size_t rb_frozen_next(const rb_frozen_t *frozen, size_t i);
+static size_t rb_frozen_prev(const rb_frozen_t *frozen, size_t i);
+static unsigned rb_stree_rank(const int64_t *node, int64_t key);
+static size_t rb_stree_upper_bound(const rb_stree_t *stree, int64_t key);
+
+rb_frozen_t *rb_freeze(rb_tree_t *tree) {
+    if (!tree) {
+        return NULL;
+    }
+    
+    rb_frozen_t *frozen = malloc(sizeof(rb_frozen_t));
+    if (!frozen) {
+        return NULL;
+    }
+    
+    frozen->size = tree->size;
+    frozen->key_type = tree->key_type;
+    frozen->key_size = tree->key_size;
+    if (tree->key_type == RB_KEY_STRING) {
+        /* Only the string pointers; the node's prefix cache is not needed */
+        frozen->key_size = sizeof(const char *);
+    }
+    frozen->compare = tree->compare;
+    frozen->keys = NULL;
+    frozen->keys_block = NULL;
+    frozen->data = malloc(sizeof(void *) * (tree->size + 1));
+    if (!frozen->data) {
+        free(frozen);
+        return NULL;
+    }
+    frozen->data[0] = NULL;
+    
+    if (frozen->key_size > 0) {
+        frozen->keys_block = malloc(frozen->key_size * (tree->size + 1) + RB_FROZEN_CACHE_LINE - 1);
+        if (!frozen->keys_block) {
+            free(frozen->data);
+            free(frozen);
+            return NULL;
+        }
+        frozen->keys = (char *)(((uintptr_t)frozen->keys_block + RB_FROZEN_CACHE_LINE - 1) &
+                                ~(uintptr_t)(RB_FROZEN_CACHE_LINE - 1));
+    }
+    
+    if (tree->size == 0) {
+        return frozen;
+    }
+    
+    /* Walk the tree and the Eytzinger array in order side by side */
+    rb_node_t *node = tree->root;
+    while (node->left != tree->nil) {
+        node = node->left;
+    }
+    
+    size_t i = rb_frozen_first(frozen);
+    while (node != tree->nil) {
+        frozen->data[i] = node->data;
+        if (frozen->key_type == RB_KEY_STRING) {
+            ((const char **)frozen->keys)[i] = rb_node_key(tree, node);
+        } else if (frozen->keys) {
+            memcpy(frozen->keys + i * frozen->key_size, rb_node_key(tree, node), frozen->key_size);
+        }
+        i = rb_frozen_next(frozen, i);
+        
+        if (node->right != tree->nil) {
+            node = node->right;
+            while (node->left != tree->nil) {
+                node = node->left;
+            }
+        } else {
+            rb_node_t *parent = rb_node_parent(node);
+            while (parent != tree->nil && node == parent->right) {
+                node = parent;
+                parent = rb_node_parent(parent);
+            }
+            node = parent;
+        }
+    }
+    
+    return frozen;
+}
+
+void rb_frozen_destroy(rb_frozen_t *frozen) {
+    if (!frozen) {
+        return;
+    }
+    
+    free(frozen->keys_block);
+    free(frozen->data);
+    free(frozen);
+}
+
+/* Branch-free descent for scalar keys. The sixteen slots four levels below i
+ * are contiguous: 128 bytes of 8-byte keys, two aligned cache lines, so both
+ * are prefetched. */
+#define RB_FROZEN_DESCEND_SCALAR(type)                                  \
+    do {                                                                \
+        type k;                                                         \
+        memcpy(&k, key, sizeof(k));                                     \
+        const type *v = (const type *)frozen->keys;                     \
+        while (i <= n) {                                                \
+            RB_PREFETCH(v + 16 * i);                                    \
+            RB_PREFETCH(v + 16 * i + 8);                                \
+            i = 2 * i + ((k > v[i]) | (strict & (k == v[i])));          \
+        }                                                               \
+    } while (0)
+
+/* Eytzinger index of the first element >= key (strict: > key), 0 if none */
+static size_t rb_frozen_bound(const rb_frozen_t *frozen, const void *key, int strict) {
+    size_t n = frozen->size;
+    size_t i = 1;
+    
+    switch (frozen->key_type) {
+        case RB_KEY_INT64:
+            RB_FROZEN_DESCEND_SCALAR(int64_t);
+            break;
+        case RB_KEY_UINT64:
+            RB_FROZEN_DESCEND_SCALAR(uint64_t);
+            break;
+        case RB_KEY_DOUBLE:
+            RB_FROZEN_DESCEND_SCALAR(double);
+            break;
+        case RB_KEY_BYTES:
+            while (i <= n) {
+                RB_PREFETCH(frozen->keys + 16 * i * frozen->key_size);
+                int cmp = memcmp(key, frozen->keys + i * frozen->key_size, frozen->key_size);
+                i = 2 * i + (cmp >= 1 - strict);
+            }
+            break;
+        case RB_KEY_STRING:
+            while (i <= n) {
+                const char *const *strings = (const char *const *)frozen->keys;
+                RB_PREFETCH(strings + 8 * i);
+                int cmp = strcmp(key, strings[i]);
+                i = 2 * i + (cmp >= 1 - strict);
+            }
+            break;
+        default:
+            while (i <= n) {
+                RB_PREFETCH(frozen->data + 8 * i);
+                int cmp = frozen->compare(key, frozen->data[i]);
+                i = 2 * i + (cmp >= 1 - strict);
+            }
+            break;
+    }
+    
+    /* Undo the right turns taken after the last left turn */
+#if defined(__GNUC__) || defined(__clang__)
+    i >>= __builtin_ffsll(~(long long)i);
+#else
+    while (i & 1) {
+        i >>= 1;
+    }
+    i >>= 1;
+#endif
+    return i;
+}
+
+#undef RB_FROZEN_DESCEND_SCALAR
+
+static int rb_frozen_cmp(const rb_frozen_t *frozen, const void *key, size_t i) {
+    switch (frozen->key_type) {
+        case RB_KEY_INT64: {
+            int64_t a, b = ((const int64_t *)frozen->keys)[i];
+            memcpy(&a, key, sizeof(a));
+            return (a > b) - (a < b);
+        }
+        case RB_KEY_UINT64: {
+            uint64_t a, b = ((const uint64_t *)frozen->keys)[i];
+            memcpy(&a, key, sizeof(a));
+            return (a > b) - (a < b);
+        }
+        case RB_KEY_DOUBLE: {
+            double a, b = ((const double *)frozen->keys)[i];
+            memcpy(&a, key, sizeof(a));
+            return (a > b) - (a < b);
+        }
+        case RB_KEY_BYTES:
+            return memcmp(key, frozen->keys + i * frozen->key_size, frozen->key_size);
+        case RB_KEY_STRING:
+            return strcmp(key, ((const char *const *)frozen->keys)[i]);
+        default:
+            return frozen->compare(key, frozen->data[i]);
+    }
+}
+
+/* In-order navigation over implicit Eytzinger links */
+static size_t rb_frozen_first(const rb_frozen_t *frozen) {
+    if (frozen->size == 0) {
+        return 0;
+    }
+    
+    size_t i = 1;
+    while (2 * i <= frozen->size) {
+        i = 2 * i;
+    }
+    return i;
+}
+
+static size_t rb_frozen_last(const rb_frozen_t *frozen) {
+    if (frozen->size == 0) {
+        return 0;
+    }
+    
+    size_t i = 1;
+    while (2 * i + 1 <= frozen->size) {
+        i = 2 * i + 1;
+    }
+    return i;
+}
+
+static size_t rb_frozen_next(const rb_frozen_t *frozen, size_t i) {
+    if (2 * i + 1 <= frozen->size) {
+        i = 2 * i + 1;
+        while (2 * i <= frozen->size) {
+            i = 2 * i;
+        }
+        return i;
+    }
+    
+    /* Climb out of right children; the parent of the left child is next */
+    while (i & 1) {
+        i >>= 1;
+    }
+    return i >> 1;
+}
+
+static size_t rb_frozen_prev(const rb_frozen_t *frozen, size_t i) {
+    if (2 * i <= frozen->size) {
+        i = 2 * i;
+        while (2 * i + 1 <= frozen->size) {
+            i = 2 * i + 1;
+        }
+        return i;
+    }
+    
+    while (i > 1 && !(i & 1)) {
+        i >>= 1;
+    }
+    return i >> 1;
+}
+
+void *rb_frozen_search(const rb_frozen_t *frozen, const void *key) {
+    if (!frozen || !key) {
+        return NULL;
+    }
+    
+    size_t i = rb_frozen_bound(frozen, key, 0);
+    return (i && rb_frozen_cmp(frozen, key, i) == 0) ? frozen->data[i] : NULL;
+}
+
+size_t rb_frozen_size(const rb_frozen_t *frozen) {
+    return frozen ? frozen->size : 0;
+}
+
+void *rb_frozen_min(const rb_frozen_t *frozen) {
+    return frozen ? frozen->data[rb_frozen_first(frozen)] : NULL;
+}
+
+void *rb_frozen_max(const rb_frozen_t *frozen) {
+    return frozen ? frozen->data[rb_frozen_last(frozen)] : NULL;
+}
+
+/* Smallest element greater than key; key need not be present */
+void *rb_frozen_successor(const rb_frozen_t *frozen, const void *key) {
+    if (!frozen || !key) {
+        return NULL;
+    }
+    
+    return frozen->data[rb_frozen_bound(frozen, key, 1)];
+}
+
+/* Largest element smaller than key; key need not be present */
+void *rb_frozen_predecessor(const rb_frozen_t *frozen, const void *key) {
+    if (!frozen || !key) {
+        return NULL;
+    }
+    
+    size_t i = rb_frozen_bound(frozen, key, 0);
+    i = i ? rb_frozen_prev(frozen, i) : rb_frozen_last(frozen);
+    return frozen->data[i];
+}
+
+void rb_frozen_walk(const rb_frozen_t *frozen, rb_visit_func_t visit, void *context) {
+    if (!frozen || !visit) {
+        return;
+    }
+    
+    for (size_t i = rb_frozen_first(frozen); i != 0; i = rb_frozen_next(frozen, i)) {
+        visit(frozen->data[i], context);
+    }
+}
+
+size_t rb_frozen_count_range(const rb_frozen_t *frozen, const void *min_key, const void *max_key) {
+    if (!frozen || !min_key || !max_key) {
+        return 0;
+    }
+    
+    size_t count = 0;
+    for (size_t i = rb_frozen_bound(frozen, min_key, 0);
+         i != 0 && rb_frozen_cmp(frozen, max_key, i) >= 0;
+         i = rb_frozen_next(frozen, i)) {
+        count++;
+    }
+    return count;
+}
+
+void rb_frozen_walk_range(const rb_frozen_t *frozen, const void *min_key, const void *max_key,
+                          rb_visit_func_t visit, void *context) {
+    if (!frozen || !min_key || !max_key || !visit) {
+        return;
+    }
+    
+    for (size_t i = rb_frozen_bound(frozen, min_key, 0);
+         i != 0 && rb_frozen_cmp(frozen, max_key, i) >= 0;
+         i = rb_frozen_next(frozen, i)) {
+        visit(frozen->data[i], context);
+    }
+}
+
+/* Static B+ tree. Layer 0 holds the sorted keys padded with INT64_MAX to
+ * whole nodes. Node k of layer h > 0 has B + 1 children, nodes k * (B + 1)
+ * .. k * (B + 1) + B of layer h - 1, and key i is the smallest key under
+ * child i + 1 (INT64_MAX if that child does not exist). */
+#define RB_STREE_B RB_STREE_NODE_KEYS
+
+rb_stree_t *rb_stree_build(rb_tree_t *tree) {
+    if (!tree || tree->key_type != RB_KEY_INT64) {
+        return NULL;
+    }
+    
+    rb_stree_t *stree = malloc(sizeof(rb_stree_t));
+    if (!stree) {
+        return NULL;
+    }
+    
+    /* Layer sizes bottom-up, then offsets with the root layer first */
+    size_t layer_nodes[RB_STREE_MAX_HEIGHT];
+    size_t nodes = (tree->size + RB_STREE_B - 1) / RB_STREE_B;
+    int height = 1;
+    layer_nodes[0] = nodes > 0 ? nodes : 1;
+    while (layer_nodes[height - 1] > 1) {
+        layer_nodes[height] = (layer_nodes[height - 1] + RB_STREE_B) / (RB_STREE_B + 1);
+        height++;
+    }
+    
+    size_t total = 0;
+    for (int h = height - 1; h >= 0; h--) {
+        stree->layer_offset[h] = total;
+        total += layer_nodes[h];
+    }
+    
+    stree->size = tree->size;
+    stree->height = height;
+    stree->data = malloc(sizeof(void *) * (tree->size + 1));
+    stree->keys_block = malloc(total * RB_STREE_B * sizeof(int64_t) + RB_FROZEN_CACHE_LINE - 1);
+    if (!stree->data || !stree->keys_block) {
+        free(stree->data);
+        free(stree->keys_block);
+        free(stree);
+        return NULL;
+    }
+    stree->keys = (int64_t *)(((uintptr_t)stree->keys_block + RB_FROZEN_CACHE_LINE - 1) &
+                              ~(uintptr_t)(RB_FROZEN_CACHE_LINE - 1));
+    
+    /* Leaves: in-order copy of keys and payloads, then padding */
+    int64_t *leaves = stree->keys + stree->layer_offset[0] * RB_STREE_B;
+    size_t count = 0;
+    rb_node_t *node = tree->root;
+    while (node != tree->nil && node->left != tree->nil) {
+        node = node->left;
+    }
+    while (node != tree->nil) {
+        memcpy(&leaves[count], rb_node_key(tree, node), sizeof(int64_t));
+        stree->data[count++] = node->data;
+        
+        if (node->right != tree->nil) {
+            node = node->right;
+            while (node->left != tree->nil) {
+                node = node->left;
+            }
+        } else {
+            rb_node_t *parent = rb_node_parent(node);
+            while (parent != tree->nil && node == parent->right) {
+                node = parent;
+                parent = rb_node_parent(parent);
+            }
+            node = parent;
+        }
+    }
+    stree->data[count] = NULL;
+    for (size_t i = count; i < layer_nodes[0] * RB_STREE_B; i++) {
+        leaves[i] = INT64_MAX;
+    }
+    
+    /* Separators: follow child i + 1 down its leftmost path to a leaf */
+    for (int h = 1; h < height; h++) {
+        int64_t *layer = stree->keys + stree->layer_offset[h] * RB_STREE_B;
+        for (size_t k = 0; k < layer_nodes[h]; k++) {
+            for (size_t i = 0; i < RB_STREE_B; i++) {
+                size_t child = k * (RB_STREE_B + 1) + i + 1;
+                if (child >= layer_nodes[h - 1]) {
+                    layer[k * RB_STREE_B + i] = INT64_MAX;
+                    continue;
+                }
+                for (int l = h - 1; l > 0; l--) {
+                    child *= RB_STREE_B + 1;
+                }
+                layer[k * RB_STREE_B + i] = leaves[child * RB_STREE_B];
+            }
+        }
+    }
+    
+    return stree;
+}
+
+void rb_stree_destroy(rb_stree_t *stree) {
+    if (!stree) {
+        return;
+    }
+    
+    free(stree->keys_block);
+    free(stree->data);
+    free(stree);
+}
+
+/* Number of keys in a node that are smaller than key */
+static unsigned rb_stree_rank(const int64_t *node, int64_t key) {
+#if defined(__AVX2__)
+    __m256i x = _mm256_set1_epi64x(key);
+    unsigned mask = 0;
+    for (int j = 0; j < RB_STREE_B; j += 4) {
+        __m256i v = _mm256_load_si256((const __m256i *)(node + j));
+        mask |= (unsigned)_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(x, v))) << j;
+    }
+    return (unsigned)__builtin_popcount(mask);
+#elif defined(__SSE4_2__)
+    __m128i x = _mm_set1_epi64x(key);
+    unsigned mask = 0;
+    for (int j = 0; j < RB_STREE_B; j += 2) {
+        __m128i v = _mm_load_si128((const __m128i *)(node + j));
+        mask |= (unsigned)_mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(x, v))) << j;
+    }
+    return (unsigned)__builtin_popcount(mask);
+#else
+    unsigned rank = 0;
+    for (int j = 0; j < RB_STREE_B; j++) {
+        rank += node[j] < key;
+    }
+    return rank;
+#endif
+}
+
+/* Position of the first key >= key in leaf order (size if none) */
+size_t rb_stree_lower_bound(const rb_stree_t *stree, int64_t key) {
+    if (!stree || stree->size == 0) {
+        return 0;
+    }
+    
+    size_t k = 0;
+    for (int h = stree->height - 1; h > 0; h--) {
+        const int64_t *node = stree->keys + (stree->layer_offset[h] + k) * RB_STREE_B;
+        k = k * (RB_STREE_B + 1) + rb_stree_rank(node, key);
+    }
+    
+    const int64_t *leaf = stree->keys + (stree->layer_offset[0] + k) * RB_STREE_B;
+    size_t position = k * RB_STREE_B + rb_stree_rank(leaf, key);
+    return position < stree->size ? position : stree->size;
+}
+
+void *rb_stree_search(const rb_stree_t *stree, int64_t key) {
+    size_t position = rb_stree_lower_bound(stree, key);
+    if (!stree || position >= stree->size) {
+        return NULL;
+    }
+    
+    const int64_t *leaves = stree->keys + stree->layer_offset[0] * RB_STREE_B;
+    return leaves[position] == key ? stree->data[position] : NULL;
+}
+
+size_t rb_stree_size(const rb_stree_t *stree) {
+    return stree ? stree->size : 0;
+}
+
+/* Two descents bound the range; everything between is one leaf run */
+static size_t rb_stree_upper_bound(const rb_stree_t *stree, int64_t key) {
+    return key == INT64_MAX ? stree->size : rb_stree_lower_bound(stree, key + 1);
+}
+
+size_t rb_stree_count_range(const rb_stree_t *stree, int64_t min_key, int64_t max_key) {
+    if (!stree || min_key > max_key) {
+        return 0;
+    }
+    
+    return rb_stree_upper_bound(stree, max_key) - rb_stree_lower_bound(stree, min_key);
+}
+
+void rb_stree_walk_range(const rb_stree_t *stree, int64_t min_key, int64_t max_key,
+                         rb_visit_func_t visit, void *context) {
+    if (!stree || !visit || min_key > max_key) {
+        return;
+    }
+    
+    size_t end = rb_stree_upper_bound(stree, max_key);
+    for (size_t i = rb_stree_lower_bound(stree, min_key); i < end; i++) {
+        visit(stree->data[i], context);
+    }
+}
@@ -0,0 +1,69 @@
+#ifndef RBTREE_FROZEN_H
+#define RBTREE_FROZEN_H
+
+#include "rbtree.h"
+#include <stdint.h>
+
+/* Read-only snapshot of an rb_tree_t in Eytzinger (BFS) order: slot 1 is the
+ * root and slot i has children 2i and 2i+1, all in one array. Searches are
+ * branch-free descents that prefetch four levels ahead. The snapshot shares
+ * payload pointers with the source tree and never frees them. */
+
+typedef struct rb_frozen {
+    size_t size;
+    rb_key_type_t key_type;
+    size_t key_size;            /* Inline key stride, 0 for generic trees */
+    rb_compare_func_t compare;
+    void **data;                /* data[1..size] in Eytzinger order */
+    char *keys;                 /* Inline keys in the same order, NULL if generic */
+    void *keys_block;           /* Allocation behind keys (cache line aligned) */
+} rb_frozen_t;
+
+/* Snapshot management */
+rb_frozen_t *rb_freeze(rb_tree_t *tree);
+void rb_frozen_destroy(rb_frozen_t *frozen);
+
+/* Lookups; keys are probes of the source tree's key type */
+void *rb_frozen_search(const rb_frozen_t *frozen, const void *key);
+size_t rb_frozen_size(const rb_frozen_t *frozen);
+
+/* Ordered operations */
+void *rb_frozen_min(const rb_frozen_t *frozen);
+void *rb_frozen_max(const rb_frozen_t *frozen);
+void *rb_frozen_successor(const rb_frozen_t *frozen, const void *key);
+void *rb_frozen_predecessor(const rb_frozen_t *frozen, const void *key);
+void rb_frozen_walk(const rb_frozen_t *frozen, rb_visit_func_t visit, void *context);
+size_t rb_frozen_count_range(const rb_frozen_t *frozen, const void *min_key, const void *max_key);
+void rb_frozen_walk_range(const rb_frozen_t *frozen, const void *min_key, const void *max_key,
+                          rb_visit_func_t visit, void *context);
+
+/* Static B+ tree (S-tree) over int64 keys: 16-key nodes stored layer by
+ * layer in one cache-line aligned array, child positions implicit. A node
+ * is searched with one vector compare per 4 keys under AVX2 (SSE4.2: 2
+ * keys), with a scalar loop otherwise. Leaves hold every key in order, so
+ * range operations are contiguous scans. */
+
+#define RB_STREE_NODE_KEYS 16
+#define RB_STREE_MAX_HEIGHT 16
+
+typedef struct rb_stree {
+    size_t size;
+    int height;                 /* Layers including the leaves */
+    size_t layer_offset[RB_STREE_MAX_HEIGHT]; /* First node of each layer, 0 = leaves */
+    int64_t *keys;              /* Nodes of RB_STREE_NODE_KEYS keys, root layer first */
+    void *keys_block;           /* Allocation behind keys (cache line aligned) */
+    void **data;                /* Payloads in key order, matching the leaf keys */
+} rb_stree_t;
+
+/* Build from an RB_KEY_INT64 tree; NULL for other key types */
+rb_stree_t *rb_stree_build(rb_tree_t *tree);
+void rb_stree_destroy(rb_stree_t *stree);
+
+void *rb_stree_search(const rb_stree_t *stree, int64_t key);
+size_t rb_stree_size(const rb_stree_t *stree);
+size_t rb_stree_lower_bound(const rb_stree_t *stree, int64_t key);
+size_t rb_stree_count_range(const rb_stree_t *stree, int64_t min_key, int64_t max_key);
+void rb_stree_walk_range(const rb_stree_t *stree, int64_t min_key, int64_t max_key,
+                         rb_visit_func_t visit, void *context);
+
+#endif /* RBTREE_FROZEN_H */
@@ -0,0 +1,555 @@
+#include "rbtree_index.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define RB_INDEX_INITIAL_CAPACITY 64
+
+/* Slot accessor; only valid until the node array is grown */
+#define NODE(i) (tree->nodes[(i)])
+
+static rb_index_t rb_index_node_alloc(rb_index_tree_t *tree);
+static void rb_index_node_free(rb_index_tree_t *tree, rb_index_t i);
+static rb_index_t rb_index_find_node(rb_index_tree_t *tree, const void *data);
+static rb_index_t rb_index_minimum_node(rb_index_tree_t *tree, rb_index_t i);
+static void rb_index_left_rotate(rb_index_tree_t *tree, rb_index_t x);
+static void rb_index_right_rotate(rb_index_tree_t *tree, rb_index_t y);
+static void rb_index_insert_fixup(rb_index_tree_t *tree, rb_index_t z);
+static void rb_index_delete_fixup(rb_index_tree_t *tree, rb_index_t x);
+static void rb_index_transplant(rb_index_tree_t *tree, rb_index_t u, rb_index_t v);
+static int rb_index_height_node(rb_index_tree_t *tree, rb_index_t i);
+static bool rb_index_is_valid_node(rb_index_tree_t *tree, rb_index_t i, int *black_height);
+
+rb_index_tree_t *rb_index_tree_create(rb_compare_func_t compare_func, rb_free_func_t free_func) {
+    if (!compare_func) {
+        return NULL;
+    }
+    
+    rb_index_tree_t *tree = malloc(sizeof(rb_index_tree_t));
+    if (!tree) {
+        return NULL;
+    }
+    
+    tree->nodes = malloc(sizeof(rb_index_node_t) * RB_INDEX_INITIAL_CAPACITY);
+    if (!tree->nodes) {
+        free(tree);
+        return NULL;
+    }
+    
+    NODE(RB_INDEX_NIL).data = NULL;
+    NODE(RB_INDEX_NIL).left = RB_INDEX_NIL;
+    NODE(RB_INDEX_NIL).right = RB_INDEX_NIL;
+    NODE(RB_INDEX_NIL).parent = RB_INDEX_NIL;
+    NODE(RB_INDEX_NIL).color = RB_BLACK;
+    
+    tree->root = RB_INDEX_NIL;
+    tree->free_list = RB_INDEX_NIL;
+    tree->used = 1;
+    tree->capacity = RB_INDEX_INITIAL_CAPACITY;
+    tree->size = 0;
+    tree->compare = compare_func;
+    tree->free_data = free_func;
+    
+    return tree;
+}
+
+static void destroy_index_data(void *data, void *context) {
+    rb_index_tree_t *tree = (rb_index_tree_t *)context;
+    tree->free_data(data);
+}
+
+void rb_index_tree_destroy(rb_index_tree_t *tree) {
+    if (!tree) {
+        return;
+    }
+    
+    /* Live and free slots are interleaved, so walk the tree rather than the array */
+    if (tree->free_data) {
+        rb_index_inorder_walk(tree, destroy_index_data, tree);
+    }
+    
+    free(tree->nodes);
+    free(tree);
+}
+
+rb_result_t rb_index_tree_reserve(rb_index_tree_t *tree, size_t capacity) {
+    if (!tree) {
+        return RB_ERROR;
+    }
+    
+    /* One extra slot for the sentinel */
+    if (capacity >= RB_INDEX_MAX) {
+        return RB_MEMORY_ERROR;
+    }
+    capacity++;
+    
+    if (capacity <= tree->capacity) {
+        return RB_OK;
+    }
+    
+    rb_index_node_t *nodes = realloc(tree->nodes, sizeof(rb_index_node_t) * capacity);
+    if (!nodes) {
+        return RB_MEMORY_ERROR;
+    }
+    
+    tree->nodes = nodes;
+    tree->capacity = (rb_index_t)capacity;
+    return RB_OK;
+}
+
+rb_index_tree_t *rb_index_tree_copy(const rb_index_tree_t *tree) {
+    if (!tree) {
+        return NULL;
+    }
+    
+    rb_index_tree_t *copy = malloc(sizeof(rb_index_tree_t));
+    if (!copy) {
+        return NULL;
+    }
+    
+    /* Links are slot numbers, so a byte copy of the array is a valid tree */
+    *copy = *tree;
+    copy->capacity = tree->used;
+    copy->nodes = malloc(sizeof(rb_index_node_t) * tree->used);
+    if (!copy->nodes) {
+        free(copy);
+        return NULL;
+    }
+    memcpy(copy->nodes, tree->nodes, sizeof(rb_index_node_t) * tree->used);
+    
+    /* Payloads are shared with the source tree, which keeps ownership */
+    copy->free_data = NULL;
+    
+    return copy;
+}
+
+static rb_index_t rb_index_node_alloc(rb_index_tree_t *tree) {
+    if (tree->free_list != RB_INDEX_NIL) {
+        rb_index_t i = tree->free_list;
+        tree->free_list = NODE(i).left;
+        return i;
+    }
+    
+    if (tree->used == tree->capacity) {
+        size_t grown = (size_t)tree->capacity * 2;
+        if (grown > RB_INDEX_MAX) {
+            grown = RB_INDEX_MAX;
+        }
+        if (grown == tree->capacity) {
+            return RB_INDEX_NIL;
+        }
+        
+        rb_index_node_t *nodes = realloc(tree->nodes, sizeof(rb_index_node_t) * grown);
+        if (!nodes) {
+            return RB_INDEX_NIL;
+        }
+        tree->nodes = nodes;
+        tree->capacity = (rb_index_t)grown;
+    }
+    
+    return tree->used++;
+}
+
+static void rb_index_node_free(rb_index_tree_t *tree, rb_index_t i) {
+    NODE(i).data = NULL;
+    NODE(i).left = tree->free_list;
+    tree->free_list = i;
+}
+
+static void rb_index_left_rotate(rb_index_tree_t *tree, rb_index_t x) {
+    rb_index_t y = NODE(x).right;
+    
+    NODE(x).right = NODE(y).left;
+    if (NODE(y).left != RB_INDEX_NIL) {
+        NODE(NODE(y).left).parent = x;
+    }
+    
+    NODE(y).parent = NODE(x).parent;
+    if (NODE(x).parent == RB_INDEX_NIL) {
+        tree->root = y;
+    } else if (x == NODE(NODE(x).parent).left) {
+        NODE(NODE(x).parent).left = y;
+    } else {
+        NODE(NODE(x).parent).right = y;
+    }
+    
+    NODE(y).left = x;
+    NODE(x).parent = y;
+}
+
+static void rb_index_right_rotate(rb_index_tree_t *tree, rb_index_t y) {
+    rb_index_t x = NODE(y).left;
+    
+    NODE(y).left = NODE(x).right;
+    if (NODE(x).right != RB_INDEX_NIL) {
+        NODE(NODE(x).right).parent = y;
+    }
+    
+    NODE(x).parent = NODE(y).parent;
+    if (NODE(y).parent == RB_INDEX_NIL) {
+        tree->root = x;
+    } else if (y == NODE(NODE(y).parent).left) {
+        NODE(NODE(y).parent).left = x;
+    } else {
+        NODE(NODE(y).parent).right = x;
+    }
+    
+    NODE(x).right = y;
+    NODE(y).parent = x;
+}
+
+static void rb_index_insert_fixup(rb_index_tree_t *tree, rb_index_t z) {
+    while (NODE(NODE(z).parent).color == RB_RED) {
+        rb_index_t p = NODE(z).parent;
+        rb_index_t g = NODE(p).parent;
+        
+        if (p == NODE(g).left) {
+            rb_index_t y = NODE(g).right;
+            if (NODE(y).color == RB_RED) {
+                NODE(p).color = RB_BLACK;
+                NODE(y).color = RB_BLACK;
+                NODE(g).color = RB_RED;
+                z = g;
+            } else {
+                if (z == NODE(p).right) {
+                    z = p;
+                    rb_index_left_rotate(tree, z);
+                }
+                NODE(NODE(z).parent).color = RB_BLACK;
+                NODE(NODE(NODE(z).parent).parent).color = RB_RED;
+                rb_index_right_rotate(tree, NODE(NODE(z).parent).parent);
+            }
+        } else {
+            rb_index_t y = NODE(g).left;
+            if (NODE(y).color == RB_RED) {
+                NODE(p).color = RB_BLACK;
+                NODE(y).color = RB_BLACK;
+                NODE(g).color = RB_RED;
+                z = g;
+            } else {
+                if (z == NODE(p).left) {
+                    z = p;
+                    rb_index_right_rotate(tree, z);
+                }
+                NODE(NODE(z).parent).color = RB_BLACK;
+                NODE(NODE(NODE(z).parent).parent).color = RB_RED;
+                rb_index_left_rotate(tree, NODE(NODE(z).parent).parent);
+            }
+        }
+    }
+    NODE(tree->root).color = RB_BLACK;
+}
+
+rb_result_t rb_index_insert(rb_index_tree_t *tree, void *data) {
+    if (!tree || !data) {
+        return RB_ERROR;
+    }
+    
+    rb_index_t y = RB_INDEX_NIL;
+    rb_index_t x = tree->root;
+    int cmp = 0;
+    
+    while (x != RB_INDEX_NIL) {
+        y = x;
+        cmp = tree->compare(data, NODE(x).data);
+        if (cmp < 0) {
+            x = NODE(x).left;
+        } else if (cmp > 0) {
+            x = NODE(x).right;
+        } else {
+            return RB_DUPLICATE;
+        }
+    }
+    
+    /* May move the node array; only indices are held across this call */
+    rb_index_t z = rb_index_node_alloc(tree);
+    if (z == RB_INDEX_NIL) {
+        return RB_MEMORY_ERROR;
+    }
+    
+    NODE(z).data = data;
+    NODE(z).left = RB_INDEX_NIL;
+    NODE(z).right = RB_INDEX_NIL;
+    NODE(z).parent = y;
+    NODE(z).color = RB_RED;
+    
+    if (y == RB_INDEX_NIL) {
+        tree->root = z;
+    } else if (cmp < 0) {
+        NODE(y).left = z;
+    } else {
+        NODE(y).right = z;
+    }
+    
+    rb_index_insert_fixup(tree, z);
+    tree->size++;
+    
+    return RB_OK;
+}
+
+static void rb_index_transplant(rb_index_tree_t *tree, rb_index_t u, rb_index_t v) {
+    if (NODE(u).parent == RB_INDEX_NIL) {
+        tree->root = v;
+    } else if (u == NODE(NODE(u).parent).left) {
+        NODE(NODE(u).parent).left = v;
+    } else {
+        NODE(NODE(u).parent).right = v;
+    }
+    NODE(v).parent = NODE(u).parent;
+}
+
+static void rb_index_delete_fixup(rb_index_tree_t *tree, rb_index_t x) {
+    while (x != tree->root && NODE(x).color == RB_BLACK) {
+        rb_index_t p = NODE(x).parent;
+        
+        if (x == NODE(p).left) {
+            rb_index_t w = NODE(p).right;
+            if (NODE(w).color == RB_RED) {
+                NODE(w).color = RB_BLACK;
+                NODE(p).color = RB_RED;
+                rb_index_left_rotate(tree, p);
+                w = NODE(p).right;
+            }
+            if (NODE(NODE(w).left).color == RB_BLACK && NODE(NODE(w).right).color == RB_BLACK) {
+                NODE(w).color = RB_RED;
+                x = p;
+            } else {
+                if (NODE(NODE(w).right).color == RB_BLACK) {
+                    NODE(NODE(w).left).color = RB_BLACK;
+                    NODE(w).color = RB_RED;
+                    rb_index_right_rotate(tree, w);
+                    w = NODE(p).right;
+                }
+                NODE(w).color = NODE(p).color;
+                NODE(p).color = RB_BLACK;
+                NODE(NODE(w).right).color = RB_BLACK;
+                rb_index_left_rotate(tree, p);
+                x = tree->root;
+            }
+        } else {
+            rb_index_t w = NODE(p).left;
+            if (NODE(w).color == RB_RED) {
+                NODE(w).color = RB_BLACK;
+                NODE(p).color = RB_RED;
+                rb_index_right_rotate(tree, p);
+                w = NODE(p).left;
+            }
+            if (NODE(NODE(w).right).color == RB_BLACK && NODE(NODE(w).left).color == RB_BLACK) {
+                NODE(w).color = RB_RED;
+                x = p;
+            } else {
+                if (NODE(NODE(w).left).color == RB_BLACK) {
+                    NODE(NODE(w).right).color = RB_BLACK;
+                    NODE(w).color = RB_RED;
+                    rb_index_left_rotate(tree, w);
+                    w = NODE(p).left;
+                }
+                NODE(w).color = NODE(p).color;
+                NODE(p).color = RB_BLACK;
+                NODE(NODE(w).left).color = RB_BLACK;
+                rb_index_right_rotate(tree, p);
+                x = tree->root;
+            }
+        }
+    }
+    NODE(x).color = RB_BLACK;
+}
+
+static rb_index_t rb_index_find_node(rb_index_tree_t *tree, const void *data) {
+    rb_index_t current = tree->root;
+    
+    while (current != RB_INDEX_NIL) {
+        int cmp = tree->compare(data, NODE(current).data);
+        if (cmp < 0) {
+            current = NODE(current).left;
+        } else if (cmp > 0) {
+            current = NODE(current).right;
+        } else {
+            return current;
+        }
+    }
+    
+    return RB_INDEX_NIL;
+}
+
+static rb_index_t rb_index_minimum_node(rb_index_tree_t *tree, rb_index_t i) {
+    while (NODE(i).left != RB_INDEX_NIL) {
+        i = NODE(i).left;
+    }
+    return i;
+}
+
+rb_result_t rb_index_delete(rb_index_tree_t *tree, const void *data) {
+    if (!tree || !data) {
+        return RB_ERROR;
+    }
+    
+    rb_index_t z = rb_index_find_node(tree, data);
+    if (z == RB_INDEX_NIL) {
+        return RB_NOT_FOUND;
+    }
+    
+    rb_index_t y = z;
+    rb_index_t x;
+    uint32_t y_original_color = NODE(y).color;
+    
+    if (NODE(z).left == RB_INDEX_NIL) {
+        x = NODE(z).right;
+        rb_index_transplant(tree, z, NODE(z).right);
+    } else if (NODE(z).right == RB_INDEX_NIL) {
+        x = NODE(z).left;
+        rb_index_transplant(tree, z, NODE(z).left);
+    } else {
+        y = rb_index_minimum_node(tree, NODE(z).right);
+        y_original_color = NODE(y).color;
+        x = NODE(y).right;
+        if (NODE(y).parent == z) {
+            NODE(x).parent = y;
+        } else {
+            rb_index_transplant(tree, y, NODE(y).right);
+            NODE(y).right = NODE(z).right;
+            NODE(NODE(y).right).parent = y;
+        }
+        rb_index_transplant(tree, z, y);
+        NODE(y).left = NODE(z).left;
+        NODE(NODE(y).left).parent = y;
+        NODE(y).color = NODE(z).color;
+    }
+    
+    if (y_original_color == RB_BLACK) {
+        rb_index_delete_fixup(tree, x);
+    }
+    
+    void *removed = NODE(z).data;
+    rb_index_node_free(tree, z);
+    tree->size--;
+    
+    if (tree->free_data) {
+        tree->free_data(removed);
+    }
+    
+    return RB_OK;
+}
+
+void *rb_index_search(rb_index_tree_t *tree, const void *data) {
+    if (!tree || !data) {
+        return NULL;
+    }
+    
+    rb_index_t i = rb_index_find_node(tree, data);
+    return (i != RB_INDEX_NIL) ? NODE(i).data : NULL;
+}
+
+void *rb_index_min(rb_index_tree_t *tree) {
+    if (!tree || tree->root == RB_INDEX_NIL) {
+        return NULL;
+    }
+    
+    return NODE(rb_index_minimum_node(tree, tree->root)).data;
+}
+
+void *rb_index_max(rb_index_tree_t *tree) {
+    if (!tree || tree->root == RB_INDEX_NIL) {
+        return NULL;
+    }
+    
+    rb_index_t i = tree->root;
+    while (NODE(i).right != RB_INDEX_NIL) {
+        i = NODE(i).right;
+    }
+    return NODE(i).data;
+}
+
+void rb_index_inorder_walk(rb_index_tree_t *tree, rb_visit_func_t visit, void *context) {
+    if (!tree || !visit || tree->root == RB_INDEX_NIL) {
+        return;
+    }
+    
+    /* Parent links make the walk iterative without an explicit stack */
+    rb_index_t current = rb_index_minimum_node(tree, tree->root);
+    while (current != RB_INDEX_NIL) {
+        rb_index_t next;
+        if (NODE(current).right != RB_INDEX_NIL) {
+            next = rb_index_minimum_node(tree, NODE(current).right);
+        } else {
+            rb_index_t child = current;
+            next = NODE(current).parent;
+            while (next != RB_INDEX_NIL && child == NODE(next).right) {
+                child = next;
+                next = NODE(next).parent;
+            }
+        }
+        
+        /* Step before visiting so the visitor may release the payload */
+        visit(NODE(current).data, context);
+        current = next;
+    }
+}
+
+size_t rb_index_size(rb_index_tree_t *tree) {
+    return tree ? tree->size : 0;
+}
+
+static int rb_index_height_node(rb_index_tree_t *tree, rb_index_t i) {
+    if (i == RB_INDEX_NIL) {
+        return 0;
+    }
+    
+    int left_height = rb_index_height_node(tree, NODE(i).left);
+    int right_height = rb_index_height_node(tree, NODE(i).right);
+    
+    return 1 + (left_height > right_height ? left_height : right_height);
+}
+
+int rb_index_height(rb_index_tree_t *tree) {
+    if (!tree) {
+        return -1;
+    }
+    return rb_index_height_node(tree, tree->root);
+}
+
+static bool rb_index_is_valid_node(rb_index_tree_t *tree, rb_index_t i, int *black_height) {
+    if (i == RB_INDEX_NIL) {
+        *black_height = 1;
+        return true;
+    }
+    
+    if (NODE(i).color == RB_RED) {
+        if (NODE(NODE(i).left).color != RB_BLACK || NODE(NODE(i).right).color != RB_BLACK) {
+            return false;
+        }
+    }
+    
+    int left_black_height, right_black_height;
+    if (!rb_index_is_valid_node(tree, NODE(i).left, &left_black_height) ||
+        !rb_index_is_valid_node(tree, NODE(i).right, &right_black_height)) {
+        return false;
+    }
+    
+    if (left_black_height != right_black_height) {
+        return false;
+    }
+    
+    *black_height = left_black_height + (NODE(i).color == RB_BLACK ? 1 : 0);
+    return true;
+}
+
+bool rb_index_is_valid(rb_index_tree_t *tree) {
+    if (!tree) {
+        return false;
+    }
+    
+    if (tree->root != RB_INDEX_NIL && NODE(tree->root).color != RB_BLACK) {
+        return false;
+    }
+    
+    int black_height;
+    return rb_index_is_valid_node(tree, tree->root, &black_height);
+}
+
+size_t rb_index_memory_usage(rb_index_tree_t *tree) {
+    if (!tree) {
+        return 0;
+    }
+    
+    return sizeof(rb_index_tree_t) + (size_t)tree->capacity * sizeof(rb_index_node_t);
+}
@@ -0,0 +1,58 @@
+#ifndef RBTREE_INDEX_H
+#define RBTREE_INDEX_H
+
+#include "rbtree.h"
+#include <stdint.h>
+
+/* Index-linked Red-Black Tree: all nodes live in one growable array and
+ * refer to each other by 32-bit slot number. Slot 0 is the nil sentinel.
+ * Links hold no addresses, so the node array can be realloc'd, memcpy'd
+ * or written out as-is. */
+
+typedef uint32_t rb_index_t;
+
+#define RB_INDEX_NIL ((rb_index_t)0)
+#define RB_INDEX_MAX ((rb_index_t)UINT32_MAX)
+
+typedef struct {
+    void *data;
+    rb_index_t left;
+    rb_index_t right;
+    rb_index_t parent;
+    uint32_t color;
+} rb_index_node_t;
+
+typedef struct rb_index_tree {
+    rb_index_node_t *nodes;     /* nodes[0] is the nil sentinel */
+    rb_index_t root;
+    rb_index_t free_list;       /* Recycled slots chained through .left */
+    rb_index_t used;            /* Slots handed out so far, including nil */
+    rb_index_t capacity;
+    size_t size;
+    rb_compare_func_t compare;
+    rb_free_func_t free_data;
+} rb_index_tree_t;
+
+/* Tree management */
+rb_index_tree_t *rb_index_tree_create(rb_compare_func_t compare_func, rb_free_func_t free_func);
+void rb_index_tree_destroy(rb_index_tree_t *tree);
+rb_result_t rb_index_tree_reserve(rb_index_tree_t *tree, size_t capacity);
+rb_index_tree_t *rb_index_tree_copy(const rb_index_tree_t *tree);
+
+/* Data operations */
+rb_result_t rb_index_insert(rb_index_tree_t *tree, void *data);
+rb_result_t rb_index_delete(rb_index_tree_t *tree, const void *data);
+void *rb_index_search(rb_index_tree_t *tree, const void *data);
+
+/* Navigation and traversal */
+void *rb_index_min(rb_index_tree_t *tree);
+void *rb_index_max(rb_index_tree_t *tree);
+void rb_index_inorder_walk(rb_index_tree_t *tree, rb_visit_func_t visit, void *context);
+
+/* Utility */
+size_t rb_index_size(rb_index_tree_t *tree);
+int rb_index_height(rb_index_tree_t *tree);
+bool rb_index_is_valid(rb_index_tree_t *tree);
+size_t rb_index_memory_usage(rb_index_tree_t *tree);
+
+#endif /* RBTREE_INDEX_H */
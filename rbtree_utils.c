@@ -15,17 +15,28 @@ static void print_node_dot(rb_tree_t *tree, rb_node_t *node,
                           void (*print_data)(const void *data), FILE *file);
 static bool nodes_equal(rb_tree_t *tree1, rb_node_t *node1, 
                        rb_tree_t *tree2, rb_node_t *node2);
-static void count_range_nodes(rb_tree_t *tree, rb_node_t *node, 
-                             const void *min_key, const void *max_key, size_t *count);
 static void walk_range_nodes(rb_tree_t *tree, rb_node_t *node, 
                             const void *min_key, const void *max_key, 
                             rb_visit_func_t visit, void *context);
 
 /* Get comprehensive statistics about the tree */
 rb_tree_stats_t rb_get_statistics(rb_tree_t *tree) {
-    rb_tree_stats_t stats = {0, 0, 0, 0, 1000000, 0.0};
+    rb_tree_stats_t stats = {0, 0, 0, 0, 1000000, 0.0, 0, 0, 0, 0, 0, 0.0};
     
-    if (!tree || tree->root == tree->nil) {
+    if (!tree) {
+        return stats;
+    }
+    
+    stats.cache_hits = tree->cache_hits;
+    stats.cache_misses = tree->cache_misses;
+    stats.filter_bytes = rb_tree_filter_bytes(tree);
+    stats.filter_rejects = tree->filter_rejects;
+    stats.filter_false_positives = tree->filter_false_positives;
+    if (tree->filter_rejects + tree->filter_false_positives > 0) {
+        stats.filter_fp_rate = (double)tree->filter_false_positives /
+                               (tree->filter_rejects + tree->filter_false_positives);
+    }
+    if (tree->root == tree->nil) {
         return stats;
     }
     
@@ -50,7 +61,7 @@ static void collect_node_stats(rb_tree_t *tree, rb_node_t *node,
     stats->total_nodes++;
     stats->avg_depth += depth;
     
-    if (node->color == RB_RED) {
+    if (rb_node_color(node) == RB_RED) {
         stats->red_nodes++;
     } else {
         stats->black_nodes++;
@@ -79,6 +90,16 @@ void rb_print_statistics(rb_tree_stats_t *stats) {
            stats->total_nodes > 0 ? log2(stats->total_nodes + 1) : 0.0);
     printf("Theoretical max: %.0f\n", 
            stats->total_nodes > 0 ? 2.0 * log2(stats->total_nodes + 1) : 0.0);
+    if (stats->cache_hits + stats->cache_misses > 0) {
+        printf("Cache hit rate:  %.1f%% (%llu hits, %llu misses)\n",
+               100.0 * stats->cache_hits / (stats->cache_hits + stats->cache_misses),
+               (unsigned long long)stats->cache_hits, (unsigned long long)stats->cache_misses);
+    }
+    if (stats->filter_bytes > 0) {
+        printf("Bloom filter:    %zu bytes, %.2f%% false positives (%llu rejected)\n",
+               stats->filter_bytes, 100.0 * stats->filter_fp_rate,
+               (unsigned long long)stats->filter_rejects);
+    }
     printf("================================\n");
 }
 
@@ -114,7 +135,7 @@ static void print_node_structure(rb_tree_t *tree, rb_node_t *node,
     }
     
     /* Print node data and color */
-    printf("[%c] ", node->color == RB_RED ? 'R' : 'B');
+    printf("[%c] ", rb_node_color(node) == RB_RED ? 'R' : 'B');
     print_data(node->data);
     printf("\n");
     
@@ -155,7 +176,7 @@ static void print_node_dot(rb_tree_t *tree, rb_node_t *node,
     fprintf(file, "  \"%p\" [label=\"", (void*)node);
     print_data(node->data);
     fprintf(file, "\" style=filled fillcolor=%s];\n", 
-            node->color == RB_RED ? "red" : "black");
+            rb_node_color(node) == RB_RED ? "red" : "black");
     
     /* Print edges to children */
     if (node->left != tree->nil) {
@@ -172,6 +193,15 @@ static void print_node_dot(rb_tree_t *tree, rb_node_t *node,
 }
 
 /* Iterator implementation */
+void rb_iterator_init(rb_iterator_t *iter, rb_tree_t *tree) {
+    if (!iter) {
+        return;
+    }
+    
+    iter->tree = tree;
+    iter->current = tree ? tree->nil : NULL;
+}
+
 rb_iterator_t *rb_iterator_create(rb_tree_t *tree) {
     if (!tree) {
         return NULL;
@@ -182,25 +212,12 @@ rb_iterator_t *rb_iterator_create(rb_tree_t *tree) {
         return NULL;
     }
     
-    iter->tree = tree;
-    iter->stack_capacity = 64; /* Initial capacity */
-    iter->stack = malloc(sizeof(rb_node_t*) * iter->stack_capacity);
-    if (!iter->stack) {
-        free(iter);
-        return NULL;
-    }
-    
-    iter->stack_size = 0;
-    iter->current = tree->nil;
-    
+    rb_iterator_init(iter, tree);
     return iter;
 }
 
 void rb_iterator_destroy(rb_iterator_t *iter) {
-    if (iter) {
-        free(iter->stack);
-        free(iter);
-    }
+    free(iter);
 }
 
 void *rb_iterator_first(rb_iterator_t *iter) {
@@ -208,72 +225,189 @@ void *rb_iterator_first(rb_iterator_t *iter) {
         return NULL;
     }
     
-    iter->stack_size = 0;
-    iter->current = iter->tree->root;
+    /* The tree caches its extremes */
+    iter->current = iter->tree->leftmost;
+    return (iter->current != iter->tree->nil) ? iter->current->data : NULL;
+}
+
+void *rb_iterator_last(rb_iterator_t *iter) {
+    if (!iter || !iter->tree) {
+        return NULL;
+    }
     
-    /* Go to leftmost node */
-    while (iter->current != iter->tree->nil) {
-        if (iter->stack_size >= iter->stack_capacity) {
-            iter->stack_capacity *= 2;
-            iter->stack = realloc(iter->stack, 
-                                sizeof(rb_node_t*) * iter->stack_capacity);
-            if (!iter->stack) {
-                return NULL;
-            }
-        }
-        
-        iter->stack[iter->stack_size++] = iter->current;
-        iter->current = iter->current->left;
+    iter->current = iter->tree->rightmost;
+    return (iter->current != iter->tree->nil) ? iter->current->data : NULL;
+}
+
+/* In-order successor: leftmost node of the right subtree, or else the first
+ * ancestor reached from its left side. Each edge is crossed twice over a
+ * full scan, so a step is amortized O(1). */
+void *rb_iterator_next(rb_iterator_t *iter) {
+    if (!iter || !iter->tree || iter->current == iter->tree->nil) {
+        return NULL;
     }
     
-    if (iter->stack_size > 0) {
-        iter->current = iter->stack[--iter->stack_size];
-        return iter->current->data;
+    rb_node_t *nil = iter->tree->nil;
+    rb_node_t *node = iter->current;
+    
+    if (node->right != nil) {
+        node = node->right;
+        while (node->left != nil) {
+            node = node->left;
+        }
+    } else {
+        rb_node_t *parent = rb_node_parent(node);
+        while (parent != nil && node == parent->right) {
+            node = parent;
+            parent = rb_node_parent(parent);
+        }
+        node = parent;
     }
     
-    return NULL;
+    iter->current = node;
+    return (node != nil) ? node->data : NULL;
 }
 
-void *rb_iterator_next(rb_iterator_t *iter) {
+void *rb_iterator_prev(rb_iterator_t *iter) {
     if (!iter || !iter->tree || iter->current == iter->tree->nil) {
         return NULL;
     }
     
-    /* If current has right child, go to leftmost in right subtree */
-    if (iter->current->right != iter->tree->nil) {
-        iter->current = iter->current->right;
-        while (iter->current->left != iter->tree->nil) {
-            if (iter->stack_size >= iter->stack_capacity) {
-                iter->stack_capacity *= 2;
-                iter->stack = realloc(iter->stack, 
-                                    sizeof(rb_node_t*) * iter->stack_capacity);
-                if (!iter->stack) {
-                    return NULL;
-                }
-            }
-            iter->stack[iter->stack_size++] = iter->current;
-            iter->current = iter->current->left;
+    rb_node_t *nil = iter->tree->nil;
+    rb_node_t *node = iter->current;
+    
+    if (node->left != nil) {
+        node = node->left;
+        while (node->right != nil) {
+            node = node->right;
+        }
+    } else {
+        rb_node_t *parent = rb_node_parent(node);
+        while (parent != nil && node == parent->left) {
+            node = parent;
+            parent = rb_node_parent(parent);
         }
-        return iter->current->data;
+        node = parent;
     }
     
-    /* Otherwise, go up the stack */
-    if (iter->stack_size > 0) {
-        iter->current = iter->stack[--iter->stack_size];
-        return iter->current->data;
+    iter->current = node;
+    return (node != nil) ? node->data : NULL;
+}
+
+bool rb_iterator_has_next(rb_iterator_t *iter) {
+    if (!iter || !iter->tree) {
+        return false;
     }
     
-    iter->current = iter->tree->nil;
-    return NULL;
+    return iter->current != iter->tree->nil && iter->current != iter->tree->rightmost;
 }
 
-bool rb_iterator_has_next(rb_iterator_t *iter) {
+bool rb_iterator_has_prev(rb_iterator_t *iter) {
     if (!iter || !iter->tree) {
         return false;
     }
     
-    return (iter->current != iter->tree->nil && 
-            (iter->current->right != iter->tree->nil || iter->stack_size > 0));
+    return iter->current != iter->tree->nil && iter->current != iter->tree->leftmost;
+}
+
+/* Range iterator implementation */
+void rb_range_init(rb_range_t *range, rb_tree_t *tree, const void *lo, const void *hi,
+                   unsigned flags) {
+    if (!range) {
+        return;
+    }
+    
+    range->tree = tree;
+    range->next = NULL;
+    range->last = NULL;
+    range->lo = lo;
+    range->hi = hi;
+    range->flags = flags;
+    if (!tree) {
+        return;
+    }
+    
+    if (!(flags & RB_RANGE_REVERSE)) {
+        if (!lo) {
+            range->next = rb_min_node(tree);
+        } else if (flags & RB_RANGE_EXCLUDE_LO) {
+            range->next = rb_upper_bound_node(tree, lo);
+        } else {
+            range->next = rb_lower_bound_node(tree, lo);
+        }
+    } else {
+        if (!hi) {
+            range->next = rb_max_node(tree);
+        } else {
+            /* Strictly below hi: the floor, stepped back once on a match */
+            range->next = rb_floor_node(tree, hi);
+            if (range->next && (flags & RB_RANGE_EXCLUDE_HI) &&
+                rb_compare_key(tree, hi, range->next) == 0) {
+                range->next = rb_prev_node(tree, range->next);
+            }
+        }
+    }
+}
+
+void *rb_range_next(rb_range_t *range) {
+    if (!range || !range->next) {
+        return NULL;
+    }
+    
+    rb_tree_t *tree = range->tree;
+    rb_node_t *node = range->next;
+    
+    /* Only the far bound needs checking; the seek already honoured the near one */
+    if (!(range->flags & RB_RANGE_REVERSE)) {
+        if (range->hi) {
+            int cmp = rb_compare_key(tree, range->hi, node);
+            if (cmp < 0 || (cmp == 0 && (range->flags & RB_RANGE_EXCLUDE_HI))) {
+                range->next = NULL;
+                return NULL;
+            }
+        }
+        range->next = rb_next_node(tree, node);
+    } else {
+        if (range->lo) {
+            int cmp = rb_compare_key(tree, range->lo, node);
+            if (cmp > 0 || (cmp == 0 && (range->flags & RB_RANGE_EXCLUDE_LO))) {
+                range->next = NULL;
+                return NULL;
+            }
+        }
+        range->next = rb_prev_node(tree, node);
+    }
+    
+    range->last = node;
+    return node->data;
+}
+
+/* Key of the last element returned, NULL before the first. It points into
+ * the node (inline keys) or the payload, so copy it if the page's elements
+ * may be deleted before the scan resumes. */
+const void *rb_range_token(const rb_range_t *range) {
+    if (!range || !range->last) {
+        return NULL;
+    }
+    
+    return rb_node_key(range->tree, range->last);
+}
+
+/* Continue a scan strictly after token in the direction of travel; end is
+ * the far bound (hi going forward, lo in reverse) */
+void rb_range_resume(rb_range_t *range, rb_tree_t *tree, const void *token, const void *end,
+                     unsigned flags) {
+    if (!token) {
+        rb_range_init(range, tree, (flags & RB_RANGE_REVERSE) ? end : NULL,
+                      (flags & RB_RANGE_REVERSE) ? NULL : end, flags);
+        return;
+    }
+    
+    if (flags & RB_RANGE_REVERSE) {
+        rb_range_init(range, tree, end, token, flags | RB_RANGE_EXCLUDE_HI);
+    } else {
+        rb_range_init(range, tree, token, end, flags | RB_RANGE_EXCLUDE_LO);
+    }
 }
 
 /* Tree comparison */
@@ -299,7 +433,7 @@ static bool nodes_equal(rb_tree_t *tree1, rb_node_t *node1,
         return false;
     }
     
-    if (tree1->compare(node1->data, node2->data) != 0) {
+    if (rb_compare_key(tree2, rb_node_key(tree1, node1), node2) != 0) {
         return false;
     }
     
@@ -313,36 +447,22 @@ size_t rb_count_range(rb_tree_t *tree, const void *min_key, const void *max_key)
         return 0;
     }
     
-    size_t count = 0;
-    count_range_nodes(tree, tree->root, min_key, max_key, &count);
-    return count;
-}
-
-static void count_range_nodes(rb_tree_t *tree, rb_node_t *node, 
-                             const void *min_key, const void *max_key, size_t *count) {
-    if (node == tree->nil) {
-        return;
-    }
-    
-    int cmp_min = tree->compare(node->data, min_key);
-    int cmp_max = tree->compare(node->data, max_key);
-    
-    if (cmp_min >= 0 && cmp_max <= 0) {
-        (*count)++;
-    }
-    
-    if (cmp_min > 0) {
-        count_range_nodes(tree, node->left, min_key, max_key, count);
+    rb_node_t *first = rb_lower_bound_node(tree, min_key);
+    if (!first || rb_compare_key(tree, max_key, first) < 0) {
+        return 0;
     }
+    rb_node_t *end = rb_upper_bound_node(tree, max_key);
     
-    if (cmp_max < 0) {
-        count_range_nodes(tree, node->right, min_key, max_key, count);
+    /* Two ranks when subtree sizes are kept, otherwise count the steps */
+    if (tree->count_offset) {
+        return rb_node_rank(tree, end) - rb_node_rank(tree, first);
     }
     
-    if (cmp_min >= 0 && cmp_max <= 0) {
-        count_range_nodes(tree, node->left, min_key, max_key, count);
-        count_range_nodes(tree, node->right, min_key, max_key, count);
+    size_t count = 0;
+    for (rb_node_t *node = first; node != end; node = rb_next_node(tree, node)) {
+        count++;
     }
+    return count;
 }
 
 void rb_walk_range(rb_tree_t *tree, const void *min_key, const void *max_key, 
@@ -361,18 +481,18 @@ static void walk_range_nodes(rb_tree_t *tree, rb_node_t *node,
         return;
     }
     
-    int cmp_min = tree->compare(node->data, min_key);
-    int cmp_max = tree->compare(node->data, max_key);
+    int cmp_min = rb_compare_key(tree, min_key, node);
+    int cmp_max = rb_compare_key(tree, max_key, node);
     
-    if (cmp_min > 0) {
+    if (cmp_min < 0) {
         walk_range_nodes(tree, node->left, min_key, max_key, visit, context);
     }
     
-    if (cmp_min >= 0 && cmp_max <= 0) {
+    if (cmp_min <= 0 && cmp_max >= 0) {
         visit(node->data, context);
     }
     
-    if (cmp_max < 0) {
+    if (cmp_max > 0) {
         walk_range_nodes(tree, node->right, min_key, max_key, visit, context);
     }
 }
@@ -383,10 +503,9 @@ size_t rb_memory_usage(rb_tree_t *tree) {
         return 0;
     }
     
-    size_t tree_overhead = sizeof(rb_tree_t) + sizeof(rb_node_t); /* NIL node */
-    size_t node_memory = tree->size * sizeof(rb_node_t);
-    
-    return tree_overhead + node_memory;
+    /* Tree header, sentinel, nodes and slab slack as the allocator sized
+     * them, plus whatever the payload callback reports */
+    return rb_tree_bytes_allocated(tree) + rb_tree_payload_bytes(tree);
 }
 
 double rb_memory_efficiency(rb_tree_t *tree) {
@@ -395,7 +514,7 @@ double rb_memory_efficiency(rb_tree_t *tree) {
     }
     
     size_t total_memory = rb_memory_usage(tree);
-    size_t data_memory = tree->size * sizeof(void*); /* Just pointer size */
+    size_t data_memory = tree->size * sizeof(void*) + rb_tree_payload_bytes(tree);
     
     return (double)data_memory / total_memory * 100.0;
 }
\ No newline at end of file
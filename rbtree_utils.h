@@ -12,17 +12,39 @@ typedef struct {
     int max_depth;
     int min_depth;
     double avg_depth;
+    uint64_t cache_hits;        /* Lookup cache counters (0 when disabled) */
+    uint64_t cache_misses;
+    size_t filter_bytes;        /* Bloom filter counters (0 when disabled) */
+    uint64_t filter_rejects;    /* Absent keys answered by the filter alone */
+    uint64_t filter_false_positives; /* Absent keys that still cost a descent */
+    double filter_fp_rate;      /* false_positives / (rejects + false_positives) */
 } rb_tree_stats_t;
 
-/* Iterator structure for tree traversal */
+/* Bidirectional iterator; steps follow parent links, so it needs no stack
+ * and can live on the caller's stack (rb_iterator_init) */
 typedef struct rb_iterator {
     rb_tree_t *tree;
-    rb_node_t **stack;
-    int stack_size;
-    int stack_capacity;
-    rb_node_t *current;
+    rb_node_t *current;         /* tree->nil before the start or past the end */
 } rb_iterator_t;
 
+/* Range iterator flags; bounds are inclusive unless excluded */
+enum {
+    RB_RANGE_EXCLUDE_LO = 1,
+    RB_RANGE_EXCLUDE_HI = 2,
+    RB_RANGE_REVERSE = 4        /* Walk from hi down to lo */
+};
+
+/* Pull-style range scan: seeks its start in one descent, then steps along
+ * parent links until the far bound. NULL bounds are open. */
+typedef struct rb_range {
+    rb_tree_t *tree;
+    rb_node_t *next;            /* Next candidate, NULL once exhausted */
+    rb_node_t *last;            /* Last node returned (source of the resume token) */
+    const void *lo;
+    const void *hi;
+    unsigned flags;
+} rb_range_t;
+
 /* Tree statistics functions */
 rb_tree_stats_t rb_get_statistics(rb_tree_t *tree);
 void rb_print_statistics(rb_tree_stats_t *stats);
@@ -32,6 +54,7 @@ void rb_print_tree_structure(rb_tree_t *tree, void (*print_data)(const void *dat
 void rb_print_dot_format(rb_tree_t *tree, void (*print_data)(const void *data), FILE *file);
 
 /* Iterator functions */
+void rb_iterator_init(rb_iterator_t *iter, rb_tree_t *tree);
 rb_iterator_t *rb_iterator_create(rb_tree_t *tree);
 void rb_iterator_destroy(rb_iterator_t *iter);
 void *rb_iterator_first(rb_iterator_t *iter);
@@ -41,6 +64,14 @@ void *rb_iterator_prev(rb_iterator_t *iter);
 bool rb_iterator_has_next(rb_iterator_t *iter);
 bool rb_iterator_has_prev(rb_iterator_t *iter);
 
+/* Range iterator functions */
+void rb_range_init(rb_range_t *range, rb_tree_t *tree, const void *lo, const void *hi,
+                   unsigned flags);
+void *rb_range_next(rb_range_t *range);
+const void *rb_range_token(const rb_range_t *range);
+void rb_range_resume(rb_range_t *range, rb_tree_t *tree, const void *token, const void *end,
+                     unsigned flags);
+
 /* Tree comparison */
 bool rb_trees_equal(rb_tree_t *tree1, rb_tree_t *tree2);
 
@@ -4,7 +4,13 @@
 #include <time.h>
 #include <assert.h>
 #include <math.h>
+#include <stddef.h>
+#include <stdint.h>
 #include "rbtree.h"
+#include "rbtree_utils.h"
+#include "rbtree_index.h"
+#include "rbtree_arena.h"
+#include "rbtree_frozen.h"
 
 int int_compare(const void *a, const void *b) {
     int ia = *(const int*)a;
@@ -217,6 +223,1847 @@ void test_string_data() {
     printf("String data test passed!\n\n");
 }
 
+void test_pool_allocator() {
+    printf("=== Testing Pool Allocator ===\n");
+    
+    rb_tree_config_t config = {0};
+    config.alloc_mode = RB_ALLOC_POOL;
+    config.pool_chunk_nodes = 16;
+    
+    rb_tree_t *tree = rb_tree_create_ex(int_compare, free_int, &config);
+    assert(tree != NULL);
+    
+    const int N = 200;
+    assert(rb_tree_reserve(tree, N) == RB_OK);
+    size_t capacity = rb_tree_capacity(tree);
+    assert(capacity >= (size_t)N);
+    
+    for (int i = 0; i < N; i++) {
+        assert(rb_insert(tree, create_int(i)) == RB_OK);
+    }
+    printf("Inserted %d values, capacity %zu (reserved %zu)\n", N, rb_tree_capacity(tree), capacity);
+    assert(rb_tree_capacity(tree) == capacity);
+    
+    for (int i = 0; i < N; i += 2) {
+        assert(rb_delete(tree, &i) == RB_OK);
+    }
+    for (int i = 0; i < N; i += 2) {
+        assert(rb_insert(tree, create_int(i)) == RB_OK);
+    }
+    
+    /* Freed nodes are recycled, so churn does not grow the pool */
+    assert(rb_tree_capacity(tree) == capacity);
+    assert(rb_size(tree) == (size_t)N);
+    assert(rb_is_valid(tree));
+    printf("Tree is valid after churn: %s\n", rb_is_valid(tree) ? "Yes" : "No");
+    
+    rb_tree_t *plain = rb_tree_create(int_compare, free_int);
+    assert(rb_tree_reserve(plain, N) == RB_ERROR);
+    rb_tree_destroy(plain);
+    
+    rb_tree_destroy(tree);
+    printf("Pool allocator test passed!\n\n");
+}
+
+typedef struct {
+    int key;
+    rb_node_t link;
+    char label[8];
+} intrusive_record_t;
+
+int intrusive_compare(const void *a, const void *b) {
+    return int_compare(&((const intrusive_record_t *)a)->key,
+                       &((const intrusive_record_t *)b)->key);
+}
+
+void test_intrusive_nodes() {
+    printf("=== Testing Intrusive Nodes ===\n");
+    
+    rb_tree_t *tree = rb_tree_create_intrusive(intrusive_compare, free,
+                                               offsetof(intrusive_record_t, link));
+    assert(tree != NULL);
+    
+    const int N = 100;
+    intrusive_record_t *records[100];
+    for (int i = 0; i < N; i++) {
+        records[i] = malloc(sizeof(intrusive_record_t));
+        records[i]->key = (i * 37) % N;
+        snprintf(records[i]->label, sizeof(records[i]->label), "r%d", records[i]->key);
+        assert(rb_insert(tree, records[i]) == RB_OK);
+    }
+    
+    /* Re-inserting a linked record must be rejected without touching its links */
+    assert(rb_insert(tree, records[0]) == RB_DUPLICATE);
+    assert(rb_is_valid(tree));
+    
+    for (int i = 0; i < N; i++) {
+        intrusive_record_t probe = {0};
+        probe.key = i;
+        intrusive_record_t *found = rb_search(tree, &probe);
+        assert(found != NULL && found->key == i);
+        assert(RB_ENTRY(&found->link, intrusive_record_t, link) == found);
+    }
+    
+    for (int i = 0; i < N; i += 3) {
+        intrusive_record_t probe = {0};
+        probe.key = i;
+        assert(rb_delete(tree, &probe) == RB_OK);
+    }
+    printf("Tree size after deletes: %zu, valid: %s\n", rb_size(tree),
+           rb_is_valid(tree) ? "Yes" : "No");
+    assert(rb_is_valid(tree));
+    
+    rb_tree_destroy(tree);
+    printf("Intrusive nodes test passed!\n\n");
+}
+
+void test_keyed_trees() {
+    printf("=== Testing Inline Key Trees ===\n");
+    
+    rb_tree_t *tree = rb_tree_create_keyed(RB_KEY_INT64, 0, NULL);
+    assert(tree != NULL);
+    
+    static int payload[64];
+    for (int64_t i = 0; i < 64; i++) {
+        int64_t key = (i * 29) % 64 - 32;
+        payload[i] = (int)key;
+        assert(rb_insert_key(tree, &key, &payload[i]) == RB_OK);
+    }
+    int64_t dup = 5;
+    assert(rb_insert_key(tree, &dup, &payload[0]) == RB_DUPLICATE);
+    assert(rb_insert(tree, &payload[0]) == RB_ERROR);
+    assert(rb_is_valid(tree));
+    
+    for (int64_t key = -32; key < 32; key++) {
+        int *found = rb_search(tree, &key);
+        assert(found != NULL && *found == key);
+    }
+    int64_t missing = 100;
+    assert(rb_search(tree, &missing) == NULL);
+    
+    int64_t probe = -1;
+    int *succ = rb_successor(tree, &probe);
+    assert(succ != NULL && *succ == 0);
+    assert(*(int *)rb_min(tree) == -32);
+    
+    for (int64_t key = -32; key < 32; key += 2) {
+        assert(rb_delete(tree, &key) == RB_OK);
+    }
+    assert(rb_size(tree) == 32);
+    assert(rb_is_valid(tree));
+    printf("int64 tree: size %zu, valid: %s\n", rb_size(tree), rb_is_valid(tree) ? "Yes" : "No");
+    rb_tree_destroy(tree);
+    
+    rb_tree_t *doubles = rb_tree_create_keyed(RB_KEY_DOUBLE, 0, NULL);
+    double dkeys[] = {3.5, -1.25, 2.0, 1e9, -7.0};
+    for (int i = 0; i < 5; i++) {
+        assert(rb_insert_key(doubles, &dkeys[i], &dkeys[i]) == RB_OK);
+    }
+    assert(*(double *)rb_min(doubles) == -7.0);
+    assert(*(double *)rb_max(doubles) == 1e9);
+    rb_tree_destroy(doubles);
+    
+    rb_tree_t *blobs = rb_tree_create_keyed(RB_KEY_BYTES, 4, NULL);
+    const char *tags[] = {"bbbb", "aaaa", "dddd", "cccc"};
+    for (int i = 0; i < 4; i++) {
+        assert(rb_insert_key(blobs, tags[i], (void *)tags[i]) == RB_OK);
+    }
+    assert(strcmp((const char *)rb_min(blobs), "aaaa") == 0);
+    assert(rb_search(blobs, "cccc") == tags[3]);
+    assert(rb_delete(blobs, "aaaa") == RB_OK);
+    assert(rb_is_valid(blobs));
+    rb_tree_destroy(blobs);
+    
+    assert(rb_tree_create_keyed(RB_KEY_BYTES, 0, NULL) == NULL);
+    printf("Inline key trees test passed!\n\n");
+}
+
+void test_index_tree() {
+    printf("=== Testing Index-Linked Tree ===\n");
+    
+    rb_index_tree_t *tree = rb_index_tree_create(int_compare, free_int);
+    assert(tree != NULL);
+    
+    /* Cross the initial capacity so the node array is reallocated mid-run */
+    const int N = 1000;
+    for (int i = 0; i < N; i++) {
+        assert(rb_index_insert(tree, create_int((i * 7919) % N)) == RB_OK);
+    }
+    int dup = 10;
+    int *dup_data = create_int(dup);
+    assert(rb_index_insert(tree, dup_data) == RB_DUPLICATE);
+    free(dup_data);
+    assert(rb_index_size(tree) == (size_t)N);
+    assert(rb_index_is_valid(tree));
+    
+    for (int i = 0; i < N; i += 2) {
+        assert(rb_index_delete(tree, &i) == RB_OK);
+    }
+    for (int i = 1; i < N; i += 2) {
+        int *found = rb_index_search(tree, &i);
+        assert(found != NULL && *found == i);
+    }
+    assert(*(int *)rb_index_min(tree) == 1);
+    assert(*(int *)rb_index_max(tree) == N - 1);
+    assert(rb_index_is_valid(tree));
+    
+    /* Freed slots are reused before the array grows again */
+    rb_index_t capacity = tree->capacity;
+    for (int i = 0; i < N; i += 2) {
+        assert(rb_index_insert(tree, create_int(i)) == RB_OK);
+    }
+    assert(tree->capacity == capacity);
+    
+    /* A byte copy of the node array is a complete, independent tree */
+    rb_index_tree_t *copy = rb_index_tree_copy(tree);
+    assert(copy != NULL && rb_index_is_valid(copy));
+    assert(rb_index_size(copy) == rb_index_size(tree));
+    int probe = 123;
+    assert(rb_index_search(copy, &probe) == rb_index_search(tree, &probe));
+    rb_index_tree_destroy(copy);
+    
+    printf("Index tree: size %zu, height %d, %zu bytes/node\n",
+           rb_index_size(tree), rb_index_height(tree), sizeof(rb_index_node_t));
+    rb_index_tree_destroy(tree);
+    printf("Index-linked tree test passed!\n\n");
+}
+
+void test_arena_trees() {
+    printf("=== Testing Arena-Bound Trees ===\n");
+    
+    rb_arena_t *arena = rb_arena_create(4096);
+    assert(arena != NULL);
+    
+    rb_tree_config_t config = {0};
+    config.alloc_mode = RB_ALLOC_ARENA;
+    config.arena = arena;
+    
+    /* Arena trees cannot own individually freed payloads */
+    assert(rb_tree_create_ex(int_compare, free_int, &config) == NULL);
+    
+    for (int round = 0; round < 3; round++) {
+        rb_tree_t *tree = rb_tree_create_ex(int_compare, NULL, &config);
+        assert(tree != NULL);
+        
+        for (int i = 0; i < 500; i++) {
+            int *value = rb_arena_alloc(arena, sizeof(int));
+            *value = (i * 31) % 500;
+            assert(rb_insert(tree, value) == RB_OK);
+        }
+        for (int i = 0; i < 500; i += 5) {
+            assert(rb_delete(tree, &i) == RB_OK);
+        }
+        assert(rb_size(tree) == 400);
+        assert(rb_is_valid(tree));
+        
+        rb_tree_clear(tree);
+        assert(rb_is_empty(tree) && rb_min(tree) == NULL);
+        int one = 1;
+        assert(rb_insert(tree, &one) == RB_OK);
+        
+        /* O(1): nothing is visited, the arena reclaims tree, nodes and payloads */
+        rb_tree_destroy(tree);
+        rb_arena_reset(arena);
+    }
+    printf("Arena reserved after reset: %zu bytes\n", rb_arena_bytes_reserved(arena));
+    rb_arena_destroy(arena);
+    
+    /* Clear-and-refill cycles reuse the tree's chunks instead of growing the arena */
+    arena = rb_arena_create(0);
+    config.arena = arena;
+    rb_tree_t *tree = rb_tree_create_ex(int_compare, NULL, &config);
+    static int keys[5000];
+    size_t reserved = 0, bytes = 0;
+    for (int round = 0; round < 5; round++) {
+        for (int i = 0; i < 5000; i++) {
+            keys[i] = i;
+            assert(rb_insert(tree, &keys[i]) == RB_OK);
+        }
+        if (round == 0) {
+            reserved = rb_arena_bytes_reserved(arena);
+            bytes = rb_tree_bytes_allocated(tree);
+        }
+        assert(rb_arena_bytes_reserved(arena) == reserved);
+        assert(rb_tree_bytes_allocated(tree) == bytes);
+        rb_tree_clear(tree);
+        assert(rb_tree_capacity(tree) >= 5000);
+    }
+    
+    /* The exact-size chunk left by compaction counts toward a reserve too */
+    tree = rb_tree_create_ex(int_compare, NULL, &config);
+    for (int i = 0; i < 100; i++) {
+        assert(rb_insert(tree, &keys[i]) == RB_OK);
+    }
+    assert(rb_tree_compact(tree, RB_LAYOUT_VEB) == RB_OK);
+    rb_tree_clear(tree);
+    size_t capacity = rb_tree_capacity(tree);
+    assert(capacity >= 100 && capacity + 500 <= 5000);
+    assert(rb_tree_reserve(tree, capacity) == RB_OK);
+    assert(rb_tree_capacity(tree) == capacity);
+    assert(rb_tree_reserve(tree, capacity + 500) == RB_OK);
+    reserved = rb_arena_bytes_reserved(arena);
+    bytes = rb_tree_bytes_allocated(tree);
+    for (size_t i = 0; i < capacity + 500; i++) {
+        assert(rb_insert(tree, &keys[i]) == RB_OK);
+    }
+    assert(rb_tree_bytes_allocated(tree) == bytes);
+    assert(rb_arena_bytes_reserved(arena) == reserved);
+    rb_arena_destroy(arena);
+    
+    tree = rb_tree_create(int_compare, free_int);
+    for (int i = 0; i < 100; i++) {
+        rb_insert(tree, create_int(i));
+    }
+    rb_tree_clear(tree);
+    assert(rb_size(tree) == 0 && rb_is_valid(tree));
+    assert(rb_insert(tree, create_int(7)) == RB_OK);
+    rb_tree_destroy(tree);
+    
+    printf("Arena-bound trees test passed!\n\n");
+}
+
+static void collect_ints(void *data, void *context) {
+    int **cursor = (int **)context;
+    **cursor = *(int *)data;
+    (*cursor)++;
+}
+
+void test_compaction() {
+    printf("=== Testing Compaction ===\n");
+    
+    rb_layout_t layouts[] = {RB_LAYOUT_VEB, RB_LAYOUT_BFS, RB_LAYOUT_DFS};
+    const char *names[] = {"vEB", "BFS", "DFS"};
+    const int N = 2000;
+    int *before = malloc(sizeof(int) * N);
+    int *after = malloc(sizeof(int) * N);
+    
+    for (int l = 0; l < 3; l++) {
+        rb_tree_config_t config = {0};
+        config.alloc_mode = (l == 1) ? RB_ALLOC_POOL : RB_ALLOC_MALLOC;
+        rb_tree_t *tree = rb_tree_create_ex(int_compare, free_int, &config);
+        
+        for (int i = 0; i < N; i++) {
+            rb_insert(tree, create_int((i * 7) % N));
+        }
+        for (int i = 0; i < N; i += 3) {
+            rb_delete(tree, &i);
+        }
+        
+        int *cursor = before;
+        rb_inorder_walk(tree, collect_ints, &cursor);
+        size_t size = rb_size(tree);
+        
+        assert(rb_tree_compact(tree, layouts[l]) == RB_OK);
+        assert(rb_is_valid(tree));
+        assert(rb_size(tree) == size);
+        assert(rb_tree_capacity(tree) == size);
+        
+        cursor = after;
+        rb_inorder_walk(tree, collect_ints, &cursor);
+        assert(memcmp(before, after, sizeof(int) * size) == 0);
+        
+        /* The compacted tree stays fully mutable */
+        for (int i = 0; i < N; i += 3) {
+            assert(rb_insert(tree, create_int(i)) == RB_OK);
+        }
+        for (int i = 1; i < N; i += 2) {
+            assert(rb_delete(tree, &i) == RB_OK);
+        }
+        assert(rb_is_valid(tree));
+        printf("%s layout: size %zu -> %zu after churn, valid: %s\n", names[l], size,
+               rb_size(tree), rb_is_valid(tree) ? "Yes" : "No");
+        rb_tree_destroy(tree);
+    }
+    
+    rb_tree_t *keyed = rb_tree_create_keyed(RB_KEY_INT64, 0, NULL);
+    for (int64_t i = 0; i < 100; i++) {
+        rb_insert_key(keyed, &i, &before[0]);
+    }
+    assert(rb_tree_compact(keyed, RB_LAYOUT_VEB) == RB_OK);
+    for (int64_t i = 0; i < 100; i++) {
+        assert(rb_search(keyed, &i) == &before[0]);
+    }
+    rb_tree_destroy(keyed);
+    
+    free(before);
+    free(after);
+    printf("Compaction test passed!\n\n");
+}
+
+static size_t int_payload_size(const void *data) {
+    (void)data;
+    return sizeof(int);
+}
+
+void test_memory_accounting() {
+    printf("=== Testing Memory Accounting ===\n");
+    
+    rb_tree_config_t config = {0};
+    config.payload_size = int_payload_size;
+    rb_tree_t *tree = rb_tree_create_ex(int_compare, free_int, &config);
+    size_t empty = rb_tree_bytes_allocated(tree);
+    assert(empty >= sizeof(rb_tree_t) + tree->node_size);
+    
+    for (int i = 0; i < 1000; i++) {
+        rb_insert(tree, create_int(i));
+    }
+    assert(rb_tree_bytes_allocated(tree) >= empty + 1000 * tree->node_size);
+    assert(rb_tree_payload_bytes(tree) == 1000 * sizeof(int));
+    assert(rb_memory_usage(tree) == rb_tree_bytes_allocated(tree) + rb_tree_payload_bytes(tree));
+    
+    for (int i = 0; i < 1000; i++) {
+        rb_delete(tree, &i);
+    }
+    assert(rb_tree_bytes_allocated(tree) == empty);
+    assert(rb_tree_payload_bytes(tree) == 0);
+    
+    /* Compaction releases the scattered nodes and charges one block */
+    for (int i = 0; i < 100; i++) {
+        rb_insert(tree, create_int(i));
+    }
+    assert(rb_tree_compact(tree, RB_LAYOUT_VEB) == RB_OK);
+    rb_tree_clear(tree);
+    assert(rb_tree_bytes_allocated(tree) == empty);
+    assert(rb_tree_payload_bytes(tree) == 0);
+    rb_tree_destroy(tree);
+    
+    /* A budgeted tree refuses to grow past its cap and stays intact */
+    config.alloc_mode = RB_ALLOC_POOL;
+    config.pool_chunk_nodes = 64;
+    config.memory_budget = 16 * 1024;
+    tree = rb_tree_create_ex(int_compare, free_int, &config);
+    int inserted = 0;
+    for (int i = 0; i < 10000; i++) {
+        int *value = create_int(i);
+        if (rb_insert(tree, value) != RB_OK) {
+            free(value);
+            break;
+        }
+        inserted++;
+    }
+    assert(inserted > 0 && inserted < 10000);
+    assert(rb_memory_usage(tree) <= 16 * 1024);
+    assert(rb_size(tree) == (size_t)inserted);
+    assert(rb_is_valid(tree));
+    printf("Budget of 16 KB admitted %d elements (%zu bytes used)\n",
+           inserted, rb_memory_usage(tree));
+    
+    /* Raising the budget lets it grow again */
+    assert(rb_tree_set_memory_budget(tree, 0) == RB_OK);
+    assert(rb_insert(tree, create_int(inserted)) == RB_OK);
+    rb_tree_destroy(tree);
+    
+    printf("Memory accounting test passed!\n\n");
+}
+
+void test_hugepage_trees() {
+    printf("=== Testing Huge Page Trees ===\n");
+    
+    rb_tree_config_t config = {0};
+    config.alloc_mode = RB_ALLOC_HUGEPAGE;
+    rb_tree_t *tree = rb_tree_create_ex(int_compare, free_int, &config);
+    assert(tree != NULL);
+    
+    for (int i = 0; i < 20000; i++) {
+        assert(rb_insert(tree, create_int(i)) == RB_OK);
+    }
+    for (int i = 0; i < 20000; i += 2) {
+        assert(rb_delete(tree, &i) == RB_OK);
+    }
+    assert(rb_is_valid(tree));
+    assert(rb_size(tree) == 10000);
+    
+    /* One chunk fills a whole 2 MB mapping (or its malloc fallback) */
+    assert(rb_tree_capacity(tree) >= (2 * 1024 * 1024 - 64) / tree->node_size);
+    assert(rb_tree_hugepage_bytes(tree) % (2 * 1024 * 1024) == 0);
+    assert(rb_tree_hugepage_bytes(tree) <= rb_tree_bytes_allocated(tree));
+    printf("Huge page backed bytes: %zu\n", rb_tree_hugepage_bytes(tree));
+    
+    assert(rb_tree_compact(tree, RB_LAYOUT_VEB) == RB_OK);
+    assert(rb_is_valid(tree));
+    for (int i = 1; i < 20000; i += 2) {
+        assert(rb_search(tree, &i) != NULL);
+    }
+    
+    rb_tree_clear(tree);
+    assert(rb_tree_hugepage_bytes(tree) == 0);
+    rb_tree_destroy(tree);
+    
+    printf("Huge page test passed!\n\n");
+}
+
+void test_search_batch() {
+    printf("=== Testing Batched Search ===\n");
+    
+    rb_tree_t *tree = rb_tree_create(int_compare, free_int);
+    rb_tree_t *keyed = rb_tree_create_keyed(RB_KEY_INT64, 0, NULL);
+    for (int i = 0; i < 5000; i += 2) {
+        int *value = create_int(i);
+        rb_insert(tree, value);
+        int64_t key = i;
+        rb_insert_key(keyed, &key, value);
+    }
+    
+    /* An odd count exercises partial groups; odd keys miss */
+    const size_t n = 1237;
+    int *probes = malloc(sizeof(int) * n);
+    int64_t *probes64 = malloc(sizeof(int64_t) * n);
+    const void **keys = malloc(sizeof(void *) * n);
+    const void **keys64 = malloc(sizeof(void *) * n);
+    void **results = malloc(sizeof(void *) * n);
+    size_t expected = 0;
+    for (size_t i = 0; i < n; i++) {
+        probes[i] = rand() % 6000;
+        probes64[i] = probes[i];
+        keys[i] = &probes[i];
+        keys64[i] = &probes64[i];
+        if (rb_search(tree, &probes[i])) expected++;
+    }
+    keys[7] = NULL;
+    if (rb_search(tree, &probes[7])) expected--;
+    
+    assert(rb_search_batch(tree, keys, n, results) == expected);
+    for (size_t i = 0; i < n; i++) {
+        assert(results[i] == (i == 7 ? NULL : rb_search(tree, &probes[i])));
+    }
+    
+    keys64[7] = &probes64[7];
+    size_t hits = rb_search_batch(keyed, keys64, n, results);
+    for (size_t i = 0; i < n; i++) {
+        assert(results[i] == rb_search(keyed, &probes64[i]));
+    }
+    assert(hits >= expected);
+    
+    assert(rb_search_batch(tree, keys, 0, results) == 0);
+    assert(rb_search_batch(tree, keys, 3, results) == (size_t)(rb_search(tree, keys[0]) != NULL) +
+           (rb_search(tree, keys[1]) != NULL) + (rb_search(tree, keys[2]) != NULL));
+    printf("Batched %zu lookups, %zu hits\n", n, expected);
+    
+    free(probes);
+    free(probes64);
+    free(keys);
+    free(keys64);
+    free(results);
+    rb_tree_destroy(keyed);
+    rb_tree_destroy(tree);
+    
+    printf("Batched search test passed!\n\n");
+}
+
+static size_t finger_compares;
+
+static int counting_compare(const void *a, const void *b) {
+    finger_compares++;
+    return int_compare(a, b);
+}
+
+void test_sorted_batches() {
+    printf("=== Testing Sorted Batches ===\n");
+    
+    rb_tree_t *tree = rb_tree_create(int_compare, free_int);
+    
+    /* Sorted insert into an empty tree, then interleaved into a full one */
+    const size_t n = 3000;
+    void **items = malloc(sizeof(void *) * n);
+    for (size_t i = 0; i < n; i++) {
+        items[i] = create_int((int)i * 4);
+    }
+    size_t inserted;
+    assert(rb_insert_sorted(tree, items, n, &inserted) == RB_OK);
+    assert(inserted == n);
+    assert(rb_is_valid(tree));
+    
+    for (size_t i = 0; i < n; i++) {
+        items[i] = create_int((int)i * 2);  /* Every other one is a duplicate */
+    }
+    assert(rb_insert_sorted(tree, items, n, &inserted) == RB_OK);
+    assert(inserted == n / 2);
+    for (size_t i = 0; i < n; i += 2) {
+        free(items[i]);
+    }
+    assert(rb_is_valid(tree));
+    assert(rb_size(tree) == n + n / 2);
+    
+    /* Sorted search matches rb_search, including misses */
+    int *probes = malloc(sizeof(int) * n);
+    const void **keys = malloc(sizeof(void *) * n);
+    void **results = malloc(sizeof(void *) * n);
+    for (size_t i = 0; i < n; i++) {
+        probes[i] = (int)i * 3;
+        keys[i] = &probes[i];
+    }
+    size_t hits = rb_search_sorted(tree, keys, n, results);
+    size_t expected = 0;
+    for (size_t i = 0; i < n; i++) {
+        assert(results[i] == rb_search(tree, &probes[i]));
+        if (results[i]) expected++;
+    }
+    assert(hits == expected);
+    
+    /* Searching every key of a tree in order costs a few comparisons per
+     * key on average, in either direction, instead of a climb to the root */
+    rb_tree_t *counted = rb_tree_create(counting_compare, NULL);
+    for (size_t i = 0; i < n; i++) {
+        probes[i] = (int)i;
+        keys[i] = &probes[i];
+        assert(rb_insert(counted, &probes[i]) == RB_OK);
+    }
+    finger_compares = 0;
+    assert(rb_search_sorted(counted, keys, n, results) == n);
+    assert(finger_compares < 5 * n);
+    for (size_t i = 0; i < n; i++) {
+        keys[i] = &probes[n - 1 - i];
+    }
+    finger_compares = 0;
+    assert(rb_search_sorted(counted, keys, n, results) == n);
+    assert(finger_compares < 5 * n);
+    for (size_t i = 0; i < n; i++) {
+        assert(results[i] == &probes[n - 1 - i]);
+        keys[i] = &probes[i];
+    }
+    rb_tree_destroy(counted);
+    
+    /* Unsorted input is slower but still correct */
+    for (size_t i = 0; i < n; i++) {
+        probes[i] = rand() % (int)(n * 6);
+    }
+    rb_search_sorted(tree, keys, n, results);
+    for (size_t i = 0; i < n; i++) {
+        assert(results[i] == rb_search(tree, &probes[i]));
+    }
+    
+    /* Inline-key variant */
+    rb_tree_t *keyed = rb_tree_create_keyed(RB_KEY_INT64, 0, NULL);
+    int64_t *keys64 = malloc(sizeof(int64_t) * n);
+    const void **key_ptrs = malloc(sizeof(void *) * n);
+    for (size_t i = 0; i < n; i++) {
+        keys64[i] = (int64_t)i * 5 - 1000;
+        key_ptrs[i] = &keys64[i];
+        items[i] = &keys64[i];
+    }
+    assert(rb_insert_key_sorted(keyed, key_ptrs, items, n, &inserted) == RB_OK);
+    assert(inserted == n && rb_is_valid(keyed));
+    assert(rb_search_sorted(keyed, key_ptrs, n, results) == n);
+    assert(rb_insert_sorted(keyed, items, n, NULL) == RB_ERROR);
+    
+    printf("Sorted batches: %zu elements, %zu of %zu probes found\n", rb_size(tree), hits, n);
+    
+    free(keys64);
+    free(key_ptrs);
+    free(items);
+    free(probes);
+    free(keys);
+    free(results);
+    rb_tree_destroy(keyed);
+    rb_tree_destroy(tree);
+    
+    printf("Sorted batch test passed!\n\n");
+}
+
+static uint64_t int_hash(const void *key) {
+    return (uint64_t)(uint32_t)*(const int *)key * 0x9E3779B97F4A7C15ULL >> 32;
+}
+
+static uint64_t constant_hash(const void *key) {
+    (void)key;
+    return 42;
+}
+
+void test_lookup_cache() {
+    printf("=== Testing Lookup Cache ===\n");
+    
+    rb_tree_config_t config = {0};
+    config.hash = int_hash;
+    config.lookup_cache_slots = 100;  /* Rounded up to 128 */
+    rb_tree_t *tree = rb_tree_create_ex(int_compare, free_int, &config);
+    assert(tree != NULL);
+    
+    for (int i = 0; i < 1000; i++) {
+        rb_insert(tree, create_int(i));
+    }
+    
+    for (int round = 0; round < 10; round++) {
+        for (int i = 0; i < 8; i++) {
+            int *found = rb_search(tree, &i);
+            assert(found && *found == i);
+        }
+    }
+    rb_tree_stats_t stats = rb_get_statistics(tree);
+    assert(stats.cache_hits + stats.cache_misses == 80);
+    assert(stats.cache_hits >= 70);
+    
+    /* Deleted nodes must never be served from the cache */
+    for (int i = 0; i < 8; i += 2) {
+        assert(rb_delete(tree, &i) == RB_OK);
+        assert(rb_search(tree, &i) == NULL);
+    }
+    for (int i = 1; i < 8; i += 2) {
+        int *found = rb_search(tree, &i);
+        assert(found && *found == i);
+    }
+    
+    /* Misses are not cached: a reinserted key is found again */
+    int key = 4;
+    rb_insert(tree, create_int(key));
+    assert(rb_search(tree, &key) && *(int *)rb_search(tree, &key) == 4);
+    
+    /* Compaction moves nodes; the cache is dropped, not left dangling */
+    assert(rb_tree_compact(tree, RB_LAYOUT_BFS) == RB_OK);
+    for (int i = 1; i < 1000; i += 3) {
+        int *found = rb_search(tree, &i);
+        assert(found && *found == i);
+    }
+    printf("Hits: %llu, misses: %llu\n", (unsigned long long)tree->cache_hits,
+           (unsigned long long)tree->cache_misses);
+    rb_tree_destroy(tree);
+    
+    /* Every key colliding in one slot is still correct */
+    config.hash = constant_hash;
+    tree = rb_tree_create_ex(int_compare, free_int, &config);
+    for (int i = 0; i < 100; i++) {
+        rb_insert(tree, create_int(i));
+    }
+    for (int i = 0; i < 100; i++) {
+        assert(*(int *)rb_search(tree, &i) == i);
+        assert(rb_delete(tree, &i) == RB_OK);
+        assert(rb_search(tree, &i) == NULL);
+    }
+    rb_tree_destroy(tree);
+    
+    /* A cache without a hash function is rejected */
+    config.hash = NULL;
+    assert(rb_tree_create_ex(int_compare, free_int, &config) == NULL);
+    
+    printf("Lookup cache test passed!\n\n");
+}
+
+void test_frozen_snapshot() {
+    printf("=== Testing Frozen Snapshots ===\n");
+    
+    /* Every size up to 70 covers complete and ragged last levels */
+    for (int n = 0; n <= 70; n++) {
+        rb_tree_t *tree = rb_tree_create(int_compare, free_int);
+        for (int i = 0; i < n; i++) {
+            rb_insert(tree, create_int(i * 2));
+        }
+        rb_frozen_t *frozen = rb_freeze(tree);
+        assert(frozen && rb_frozen_size(frozen) == (size_t)n);
+        
+        int *cursor = malloc(sizeof(int) * (n + 1));
+        int *walked = cursor;
+        rb_frozen_walk(frozen, collect_ints, &walked);
+        assert(walked - cursor == n);
+        for (int i = 0; i < n; i++) {
+            assert(cursor[i] == i * 2);
+        }
+        free(cursor);
+        
+        for (int k = -1; k <= n * 2; k++) {
+            int *found = rb_frozen_search(frozen, &k);
+            assert((found != NULL) == (k >= 0 && k % 2 == 0 && k < n * 2));
+            int *next = rb_frozen_successor(frozen, &k);
+            int *prev = rb_frozen_predecessor(frozen, &k);
+            int expect_next = (k < 0) ? 0 : (k / 2 + 1) * 2;
+            int expect_prev = (k % 2 == 0) ? k - 2 : k - 1;
+            assert(next ? *next == expect_next : expect_next >= n * 2);
+            assert(prev ? *prev == expect_prev : expect_prev < 0);
+        }
+        if (n > 0) {
+            assert(*(int *)rb_frozen_min(frozen) == 0);
+            assert(*(int *)rb_frozen_max(frozen) == (n - 1) * 2);
+        } else {
+            assert(rb_frozen_min(frozen) == NULL && rb_frozen_max(frozen) == NULL);
+        }
+        
+        int lo = 5, hi = 20;
+        size_t expected = 0;
+        for (int i = 0; i < n; i++) {
+            if (i * 2 >= lo && i * 2 <= hi) expected++;
+        }
+        assert(rb_frozen_count_range(frozen, &lo, &hi) == expected);
+        
+        rb_frozen_destroy(frozen);
+        rb_tree_destroy(tree);
+    }
+    
+    /* Inline int64 keys use the branch-free scalar descent */
+    rb_tree_t *keyed = rb_tree_create_keyed(RB_KEY_INT64, 0, NULL);
+    static int payloads[1000];
+    for (int64_t i = 0; i < 1000; i++) {
+        int64_t key = i * 3 - 1500;
+        payloads[i] = (int)i;
+        rb_insert_key(keyed, &key, &payloads[i]);
+    }
+    rb_frozen_t *frozen = rb_freeze(keyed);
+    for (int64_t i = 0; i < 1000; i++) {
+        int64_t key = i * 3 - 1500;
+        assert(rb_frozen_search(frozen, &key) == &payloads[i]);
+        key++;
+        assert(rb_frozen_search(frozen, &key) == NULL);
+        assert(rb_frozen_successor(frozen, &key) == (i < 999 ? &payloads[i + 1] : NULL));
+    }
+    int64_t lo = -1500, hi = 1497;
+    assert(rb_frozen_count_range(frozen, &lo, &hi) == 1000);
+    printf("Frozen %zu int64 keys, min %d, max %d\n", rb_frozen_size(frozen),
+           *(int *)rb_frozen_min(frozen), *(int *)rb_frozen_max(frozen));
+    rb_frozen_destroy(frozen);
+    rb_tree_destroy(keyed);
+    
+    printf("Frozen snapshot test passed!\n\n");
+}
+
+static void collect_pointers(void *data, void *context) {
+    void ***cursor = (void ***)context;
+    **cursor = data;
+    (*cursor)++;
+}
+
+void test_static_btree() {
+    printf("=== Testing Static B+ Tree ===\n");
+    
+    /* Sizes around node and layer boundaries (16, 16 * 17, 16 * 17 * 17) */
+    size_t sizes[] = {0, 1, 15, 16, 17, 200, 272, 273, 1000, 4624, 4625, 6000};
+    static int64_t values[6000];
+    void **walked = malloc(sizeof(void *) * 6000);
+    
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        size_t n = sizes[s];
+        rb_tree_t *tree = rb_tree_create_keyed(RB_KEY_INT64, 0, NULL);
+        for (size_t i = 0; i < n; i++) {
+            values[i] = (int64_t)i * 10 - 300;
+            rb_insert_key(tree, &values[i], &values[i]);
+        }
+        rb_stree_t *stree = rb_stree_build(tree);
+        assert(stree && rb_stree_size(stree) == n);
+        
+        for (size_t i = 0; i < n; i++) {
+            assert(rb_stree_search(stree, values[i]) == &values[i]);
+            assert(rb_stree_search(stree, values[i] + 1) == NULL);
+            assert(rb_stree_lower_bound(stree, values[i] - 5) == i);
+        }
+        assert(rb_stree_search(stree, INT64_MIN) == NULL);
+        assert(rb_stree_search(stree, INT64_MAX) == NULL);
+        
+        /* Range scans are contiguous runs of the leaf order */
+        int64_t lo = -95, hi = 2000;
+        size_t expected = 0;
+        for (size_t i = 0; i < n; i++) {
+            if (values[i] >= lo && values[i] <= hi) expected++;
+        }
+        assert(rb_stree_count_range(stree, lo, hi) == expected);
+        assert(rb_stree_count_range(stree, INT64_MIN, INT64_MAX) == n);
+        assert(rb_stree_count_range(stree, hi, lo) == 0);
+        void **cursor = walked;
+        rb_stree_walk_range(stree, lo, hi, collect_pointers, &cursor);
+        assert((size_t)(cursor - walked) == expected);
+        for (size_t i = 1; i < expected; i++) {
+            assert(*(int64_t *)walked[i - 1] < *(int64_t *)walked[i]);
+        }
+        
+        rb_stree_destroy(stree);
+        rb_tree_destroy(tree);
+    }
+    
+    /* Extreme keys are real keys, not padding */
+    rb_tree_t *tree = rb_tree_create_keyed(RB_KEY_INT64, 0, NULL);
+    int64_t extremes[] = {INT64_MIN, -1, 0, INT64_MAX};
+    for (int i = 0; i < 4; i++) {
+        rb_insert_key(tree, &extremes[i], &extremes[i]);
+    }
+    rb_stree_t *stree = rb_stree_build(tree);
+    for (int i = 0; i < 4; i++) {
+        assert(rb_stree_search(stree, extremes[i]) == &extremes[i]);
+    }
+    assert(rb_stree_count_range(stree, 0, INT64_MAX) == 2);
+    printf("S-tree height for 4 keys: %d\n", stree->height);
+    rb_stree_destroy(stree);
+    rb_tree_destroy(tree);
+    
+    /* Only int64-keyed trees can be converted */
+    tree = rb_tree_create(int_compare, free_int);
+    assert(rb_stree_build(tree) == NULL);
+    rb_tree_destroy(tree);
+    free(walked);
+    
+    printf("Static B+ tree test passed!\n\n");
+}
+
+static int compare_strings(const void *a, const void *b) {
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+static void collect_strings(void *data, void *context) {
+    const char ***cursor = (const char ***)context;
+    **cursor = data;
+    (*cursor)++;
+}
+
+void test_string_keys() {
+    printf("=== Testing String Keys ===\n");
+    
+    /* Empty, short, exactly-8, prefix ties and bytes above 0x7f */
+    const char *words[] = {"", "a", "abcdefgh", "abcdefghi", "abcdefgha", "abcdefg",
+                           "https://example.com/users/1", "https://example.com/users/2",
+                           "https://example.com/", "/usr/share/doc", "/usr/share",
+                           "\xc3\xa9t\xc3\xa9", "zebra", "Zebra", "\xff"};
+    int n = sizeof(words) / sizeof(words[0]);
+    
+    rb_tree_t *tree = rb_tree_create_keyed(RB_KEY_STRING, 0, NULL);
+    for (int i = 0; i < n; i++) {
+        assert(rb_insert_key(tree, words[i], (void *)words[i]) == RB_OK);
+    }
+    assert(rb_is_valid(tree));
+    
+    /* A different buffer with the same contents is a duplicate */
+    char copy[32];
+    strcpy(copy, "abcdefghi");
+    assert(rb_insert_key(tree, copy, copy) == RB_DUPLICATE);
+    assert(rb_search(tree, copy) == words[3]);
+    
+    /* In-order walk matches strcmp order */
+    const char *sorted[16];
+    memcpy(sorted, words, sizeof(words));
+    qsort(sorted, n, sizeof(const char *), compare_strings);
+    const char *walked[16];
+    const char **cursor = walked;
+    rb_inorder_walk(tree, collect_strings, &cursor);
+    for (int i = 0; i < n; i++) {
+        assert(walked[i] == sorted[i] || strcmp(walked[i], sorted[i]) == 0);
+    }
+    
+    assert(rb_search(tree, "abcdefgh!") == NULL);
+    assert(rb_search(tree, "https://example.com/users/3") == NULL);
+    assert(strcmp(rb_max(tree), "\xff") == 0);
+    assert(strcmp(rb_min(tree), "") == 0);
+    
+    /* Snapshots compare the full strings */
+    rb_frozen_t *frozen = rb_freeze(tree);
+    for (int i = 0; i < n; i++) {
+        strcpy(copy, words[i]);
+        assert(rb_frozen_search(frozen, copy) == words[i]);
+    }
+    rb_frozen_destroy(frozen);
+    
+    for (int i = 0; i < n; i += 2) {
+        strcpy(copy, words[i]);
+        assert(rb_delete(tree, copy) == RB_OK);
+        assert(rb_search(tree, words[i]) == NULL);
+    }
+    assert(rb_is_valid(tree));
+    assert(rb_size(tree) == (size_t)(n / 2));
+    printf("String-keyed tree holds %zu keys after deletes\n", rb_size(tree));
+    rb_tree_destroy(tree);
+    
+    printf("String key test passed!\n\n");
+}
+
+void test_bloom_filter() {
+    printf("=== Testing Bloom Filter ===\n");
+    
+    rb_tree_config_t config = {0};
+    config.hash = int_hash;
+    config.filter_capacity = 10000;
+    rb_tree_t *tree = rb_tree_create_ex(int_compare, free_int, &config);
+    assert(tree != NULL);
+    
+    /* Even keys present, odd keys absent */
+    for (int i = 0; i < 20000; i += 2) {
+        rb_insert(tree, create_int(i));
+    }
+    for (int i = 0; i < 20000; i += 2) {
+        int *found = rb_search(tree, &i);
+        assert(found && *found == i);
+    }
+    for (int i = 1; i < 20000; i += 2) {
+        assert(rb_search(tree, &i) == NULL);
+    }
+    rb_tree_stats_t stats = rb_get_statistics(tree);
+    assert(stats.filter_bytes >= 10000 * 10 / 2 && stats.filter_bytes == rb_tree_filter_bytes(tree));
+    assert(stats.filter_rejects + stats.filter_false_positives == 10000);
+    assert(stats.filter_fp_rate < 0.05);
+    printf("Filter: %zu bytes, %.2f%% false positives\n", stats.filter_bytes,
+           100.0 * stats.filter_fp_rate);
+    
+    /* Deletes clear the counters without hiding the remaining keys */
+    for (int i = 0; i < 20000; i += 4) {
+        assert(rb_delete(tree, &i) == RB_OK);
+        assert(rb_search(tree, &i) == NULL);
+        assert(rb_delete(tree, &i) == RB_NOT_FOUND);
+    }
+    for (int i = 2; i < 20000; i += 4) {
+        int *found = rb_search(tree, &i);
+        assert(found && *found == i);
+    }
+    assert(rb_is_valid(tree));
+    
+    rb_tree_clear(tree);
+    int key = 2;
+    assert(rb_search(tree, &key) == NULL);
+    rb_insert(tree, create_int(key));
+    assert(*(int *)rb_search(tree, &key) == 2);
+    rb_tree_destroy(tree);
+    
+    /* One shared block saturates its counters; nothing goes missing */
+    config.hash = constant_hash;
+    config.filter_capacity = 16;
+    config.lookup_cache_slots = 8;
+    tree = rb_tree_create_ex(int_compare, free_int, &config);
+    for (int i = 0; i < 100; i++) {
+        rb_insert(tree, create_int(i));
+    }
+    for (int i = 0; i < 100; i += 2) {
+        assert(rb_delete(tree, &i) == RB_OK);
+    }
+    for (int i = 1; i < 100; i += 2) {
+        assert(*(int *)rb_search(tree, &i) == i);
+    }
+    rb_tree_destroy(tree);
+    
+    /* A filter without a hash function is rejected */
+    config.hash = NULL;
+    config.lookup_cache_slots = 0;
+    assert(rb_tree_create_ex(int_compare, free_int, &config) == NULL);
+    
+    printf("Bloom filter test passed!\n\n");
+}
+
+void test_bound_queries() {
+    printf("=== Testing Bound Queries ===\n");
+    
+    /* Multiples of 10 in 0..990, probed on and between keys */
+    rb_tree_t *tree = rb_tree_create(int_compare, free_int);
+    for (int i = 0; i < 100; i++) {
+        rb_insert(tree, create_int(i * 10));
+    }
+    
+    for (int probe = -15; probe <= 1005; probe++) {
+        int lower = (probe <= 0) ? 0 : (probe + 9) / 10 * 10;
+        int upper = (probe < 0) ? 0 : probe / 10 * 10 + 10;
+        int floor = (probe < 0) ? -1 : probe / 10 * 10;
+        
+        int *found = rb_lower_bound(tree, &probe);
+        assert(lower > 990 ? found == NULL : (found && *found == lower));
+        assert(rb_ceiling(tree, &probe) == found);
+        found = rb_upper_bound(tree, &probe);
+        assert(upper > 990 ? found == NULL : (found && *found == upper));
+        found = rb_floor(tree, &probe);
+        if (floor > 990) {
+            floor = 990;
+        }
+        assert(floor < 0 ? found == NULL : (found && *found == floor));
+    }
+    
+    /* Range scan from a bound node without a second search */
+    int lo = 95, hi = 305;
+    size_t count = 0;
+    int previous = -1;
+    for (rb_node_t *node = rb_lower_bound_node(tree, &lo);
+         node && *(int *)node->data <= hi; node = rb_next_node(tree, node)) {
+        assert(*(int *)node->data > previous);
+        previous = *(int *)node->data;
+        count++;
+    }
+    assert(count == 21);
+    
+    /* Backwards from a floor node */
+    count = 0;
+    for (rb_node_t *node = rb_floor_node(tree, &hi); node; node = rb_prev_node(tree, node)) {
+        count++;
+    }
+    assert(count == 31);
+    assert(*(int *)rb_min_node(tree)->data == 0);
+    assert(*(int *)rb_max_node(tree)->data == 990);
+    assert(rb_next_node(tree, rb_max_node(tree)) == NULL);
+    assert(rb_prev_node(tree, rb_min_node(tree)) == NULL);
+    rb_tree_destroy(tree);
+    
+    /* Inline keys and the empty tree */
+    rb_tree_t *keyed = rb_tree_create_keyed(RB_KEY_INT64, 0, NULL);
+    int64_t probe = 7;
+    assert(rb_lower_bound(keyed, &probe) == NULL);
+    assert(rb_floor_node(keyed, &probe) == NULL);
+    assert(rb_min_node(keyed) == NULL);
+    static int payload[3];
+    for (int64_t k = -1; k <= 1; k++) {
+        rb_insert_key(keyed, &k, &payload[k + 1]);
+    }
+    probe = 0;
+    assert(rb_lower_bound(keyed, &probe) == &payload[1]);
+    assert(rb_upper_bound(keyed, &probe) == &payload[2]);
+    probe = -100;
+    assert(rb_floor(keyed, &probe) == NULL);
+    assert(rb_upper_bound(keyed, &probe) == &payload[0]);
+    rb_tree_destroy(keyed);
+    
+    printf("Bound query test passed!\n\n");
+}
+
+void test_hinted_insert() {
+    printf("=== Testing Hinted Insertion ===\n");
+    
+    /* Ascending keys take the rightmost append path */
+    rb_tree_t *tree = rb_tree_create(int_compare, free_int);
+    for (int i = 0; i < 1000; i += 2) {
+        assert(rb_insert(tree, create_int(i)) == RB_OK);
+    }
+    assert(rb_is_valid(tree));
+    assert(*(int *)rb_max(tree) == 998);
+    int *dup = create_int(998);
+    assert(rb_insert(tree, dup) == RB_DUPLICATE);
+    free(dup);
+    
+    /* Correct hints: the neighbour on either side of the gap */
+    for (int i = 1; i < 1000; i += 4) {
+        int below = i - 1, above = i + 1;
+        rb_node_t *hint = (i % 8 == 1) ? rb_lower_bound_node(tree, &below)
+                                       : rb_lower_bound_node(tree, &above);
+        assert(rb_insert_hint(tree, hint, create_int(i)) == RB_OK);
+    }
+    assert(rb_is_valid(tree));
+    
+    /* Wrong, empty and past-the-end hints fall back to a normal insert */
+    for (int i = 3; i < 1000; i += 4) {
+        rb_node_t *hint = (i % 3 == 0) ? rb_min_node(tree) : (i % 3 == 1) ? NULL : rb_max_node(tree);
+        assert(rb_insert_hint(tree, hint, create_int(i)) == RB_OK);
+    }
+    assert(rb_is_valid(tree));
+    assert(rb_size(tree) == 1000);
+    int previous = -1;
+    for (rb_node_t *node = rb_min_node(tree); node; node = rb_next_node(tree, node)) {
+        assert(*(int *)node->data == previous + 1);
+        previous = *(int *)node->data;
+    }
+    
+    dup = create_int(500);
+    int key = 501;
+    assert(rb_insert_hint(tree, rb_lower_bound_node(tree, &key), dup) == RB_DUPLICATE);
+    free(dup);
+    
+    /* Deleting and compacting keep the cached maximum current */
+    for (int i = 999; i >= 900; i--) {
+        assert(rb_delete(tree, &i) == RB_OK);
+        assert(rb_is_valid(tree));
+    }
+    assert(rb_tree_compact(tree, RB_LAYOUT_VEB) == RB_OK);
+    assert(rb_is_valid(tree));
+    assert(rb_insert(tree, create_int(2000)) == RB_OK);
+    assert(*(int *)rb_max(tree) == 2000);
+    rb_tree_clear(tree);
+    assert(rb_is_valid(tree));
+    assert(rb_insert(tree, create_int(1)) == RB_OK);
+    rb_tree_destroy(tree);
+    
+    /* Inline keys */
+    rb_tree_t *keyed = rb_tree_create_keyed(RB_KEY_INT64, 0, NULL);
+    static int payload;
+    for (int64_t k = 0; k < 100; k += 10) {
+        assert(rb_insert_key(keyed, &k, &payload) == RB_OK);
+    }
+    int64_t k = 55, probe = 50;
+    assert(rb_insert_key_hint(keyed, rb_lower_bound_node(keyed, &probe), &k, &payload) == RB_OK);
+    assert(rb_insert_key_hint(keyed, NULL, &k, &payload) == RB_DUPLICATE);
+    assert(rb_is_valid(keyed) && rb_size(keyed) == 11);
+    rb_tree_destroy(keyed);
+    
+    printf("Hinted insertion test passed!\n\n");
+}
+
+typedef struct {
+    int key;
+    int version;
+} versioned_t;
+
+static int versioned_compare(const void *a, const void *b) {
+    return int_compare(&((const versioned_t *)a)->key, &((const versioned_t *)b)->key);
+}
+
+static void *construct_versioned(const void *key, void *context) {
+    versioned_t *record = malloc(sizeof(versioned_t));
+    record->key = *(const int *)key;
+    record->version = 0;
+    (*(int *)context)++;
+    return record;
+}
+
+void test_upsert_and_emplace() {
+    printf("=== Testing Insert-or-Get, Upsert and Emplace ===\n");
+    
+    rb_tree_t *tree = rb_tree_create(versioned_compare, free);
+    versioned_t *first = malloc(sizeof(versioned_t));
+    *first = (versioned_t){7, 1};
+    assert(rb_insert_or_get(tree, first) == first);
+    
+    /* A duplicate hands back the stored element and leaves the tree alone */
+    versioned_t probe = {7, 2};
+    assert(rb_insert_or_get(tree, &probe) == first);
+    assert(rb_size(tree) == 1);
+    
+    /* Upsert replaces the payload in place; the old one is returned or freed */
+    versioned_t *second = malloc(sizeof(versioned_t));
+    *second = (versioned_t){7, 2};
+    void *replaced = NULL;
+    assert(rb_upsert(tree, second, &replaced) == RB_OK);
+    assert(replaced == first);
+    free(first);
+    versioned_t *third = malloc(sizeof(versioned_t));
+    *third = (versioned_t){7, 3};
+    assert(rb_upsert(tree, third, NULL) == RB_OK);
+    assert(((versioned_t *)rb_search(tree, &probe))->version == 3);
+    versioned_t *fresh = malloc(sizeof(versioned_t));
+    *fresh = (versioned_t){8, 1};
+    assert(rb_upsert(tree, fresh, &replaced) == RB_OK && replaced == NULL);
+    assert(rb_size(tree) == 2);
+    
+    /* Emplace constructs only on a miss */
+    int constructed = 0;
+    void *element = NULL;
+    for (int round = 0; round < 3; round++) {
+        for (int key = 0; key < 20; key++) {
+            rb_result_t result = rb_emplace(tree, &key, construct_versioned, &constructed, &element);
+            assert(result == RB_OK || result == RB_DUPLICATE);
+            assert(element && ((versioned_t *)element)->key == key);
+        }
+    }
+    assert(constructed == 18);
+    assert(rb_size(tree) == 20);
+    assert(rb_is_valid(tree));
+    rb_tree_destroy(tree);
+    
+    /* Inline keys; string keys follow the new payload's string */
+    rb_tree_t *keyed = rb_tree_create_keyed(RB_KEY_INT64, 0, NULL);
+    static int payload[2];
+    int64_t k = 5;
+    assert(rb_insert_key_or_get(keyed, &k, &payload[0]) == &payload[0]);
+    assert(rb_insert_key_or_get(keyed, &k, &payload[1]) == &payload[0]);
+    assert(rb_upsert_key(keyed, &k, &payload[1], &replaced) == RB_OK && replaced == &payload[0]);
+    assert(rb_search(keyed, &k) == &payload[1]);
+    rb_tree_destroy(keyed);
+    
+    rb_tree_t *strings = rb_tree_create_keyed(RB_KEY_STRING, 0, NULL);
+    char *old_name = malloc(16);
+    char *new_name = malloc(16);
+    strcpy(old_name, "identifier");
+    strcpy(new_name, "identifier");
+    assert(rb_insert_key(strings, old_name, old_name) == RB_OK);
+    assert(rb_upsert_key(strings, new_name, new_name, &replaced) == RB_OK && replaced == old_name);
+    free(old_name);
+    assert(rb_search(strings, "identifier") == new_name);
+    assert(strcmp(rb_node_key(strings, rb_min_node(strings)), "identifier") == 0);
+    
+    /* Emplace would store the probe pointer, so string trees refuse it */
+    constructed = 0;
+    element = &constructed;
+    char name[16] = "fresh";
+    assert(rb_emplace(strings, name, construct_versioned, &constructed, &element) == RB_ERROR);
+    assert(element == NULL && constructed == 0 && rb_size(strings) == 1);
+    rb_tree_destroy(strings);
+    free(new_name);
+    
+    printf("Insert-or-get, upsert and emplace test passed!\n\n");
+}
+
+void test_extract() {
+    printf("=== Testing Extract and Node Reinsertion ===\n");
+    
+    rb_tree_t *source = rb_tree_create(int_compare, free_int);
+    rb_tree_t *target = rb_tree_create(int_compare, free_int);
+    for (int i = 0; i < 100; i++) {
+        rb_insert(source, create_int(i));
+    }
+    size_t source_bytes = rb_tree_bytes_allocated(source);
+    size_t target_bytes = rb_tree_bytes_allocated(target);
+    
+    /* Move the even keys node by node: no allocation, no copy */
+    for (int i = 0; i < 100; i += 2) {
+        rb_node_t *node = NULL;
+        int *data = rb_extract(source, &i, &node);
+        assert(data && *data == i && node && node->data == data);
+        assert(rb_search(source, &i) == NULL);
+        assert(rb_insert_node(target, node) == RB_OK);
+        assert(rb_search(target, &i) == data);
+    }
+    assert(rb_size(source) == 50 && rb_size(target) == 50);
+    assert(rb_is_valid(source) && rb_is_valid(target));
+    assert(rb_tree_bytes_allocated(source) + rb_tree_bytes_allocated(target) ==
+           source_bytes + target_bytes);
+    
+    /* Extracting the payload alone frees the node but not the payload */
+    int key = 51;
+    int *owned = rb_extract(source, &key, NULL);
+    assert(owned && *owned == 51);
+    free(owned);
+    assert(rb_extract(source, &key, NULL) == NULL);
+    
+    /* A node whose key is already present stays with the caller */
+    rb_insert(source, create_int(60));
+    key = 60;
+    rb_node_t *node = NULL;
+    int *data = rb_extract(target, &key, &node);
+    assert(data && *data == 60);
+    assert(rb_insert_node(source, node) == RB_DUPLICATE);
+    assert(rb_insert_node(target, node) == RB_OK);
+    
+    /* Pooled nodes belong to their tree's slabs and are never handed out */
+    rb_tree_config_t config = {0};
+    config.alloc_mode = RB_ALLOC_POOL;
+    rb_tree_t *pooled = rb_tree_create_ex(int_compare, free_int, &config);
+    rb_insert(pooled, create_int(1));
+    key = 1;
+    owned = rb_extract(pooled, &key, &node);
+    assert(owned && *owned == 1 && node == NULL);
+    assert(rb_size(pooled) == 0);
+    key = 3;
+    assert(rb_extract(source, &key, &node) != NULL);
+    assert(rb_insert_node(pooled, node) == RB_ERROR);
+    free(node->data);
+    free(node);
+    free(owned);
+    rb_tree_destroy(pooled);
+    
+    /* Inline keys travel with the node */
+    rb_tree_t *keyed_a = rb_tree_create_keyed(RB_KEY_INT64, 0, NULL);
+    rb_tree_t *keyed_b = rb_tree_create_keyed(RB_KEY_INT64, 0, NULL);
+    static int payload[10];
+    for (int64_t k = 0; k < 10; k++) {
+        rb_insert_key(keyed_a, &k, &payload[k]);
+    }
+    for (int64_t k = 9; k >= 0; k -= 3) {
+        assert(rb_extract(keyed_a, &k, &node) == &payload[k]);
+        assert(rb_insert_node(keyed_b, node) == RB_OK);
+        assert(rb_search(keyed_b, &k) == &payload[k]);
+    }
+    assert(rb_size(keyed_a) == 6 && rb_size(keyed_b) == 4);
+    assert(rb_is_valid(keyed_a) && rb_is_valid(keyed_b));
+    
+    /* Nodes only move between trees with the same layout */
+    rb_tree_config_t counted_config = {0};
+    counted_config.order_statistics = true;
+    rb_tree_t *counted = rb_tree_create_ex(int_compare, free_int, &counted_config);
+    rb_tree_t *keyed_double = rb_tree_create_keyed(RB_KEY_DOUBLE, 0, NULL);
+    key = 5;
+    data = rb_extract(source, &key, &node);
+    assert(data && rb_insert_node(counted, node) == RB_ERROR);
+    assert(rb_insert_node(keyed_a, node) == RB_ERROR);
+    assert(rb_insert_node(source, node) == RB_OK);
+    int64_t k = 2;
+    assert(rb_extract(keyed_a, &k, &node) == &payload[2]);
+    assert(rb_insert_node(source, node) == RB_ERROR);
+    assert(rb_insert_node(counted, node) == RB_ERROR);
+    assert(rb_insert_node(keyed_double, node) == RB_ERROR);
+    assert(rb_insert_node(keyed_b, node) == RB_OK);
+    assert(rb_is_valid(keyed_b) && rb_size(keyed_b) == 5);
+    rb_tree_destroy(counted);
+    rb_tree_destroy(keyed_double);
+    rb_tree_destroy(keyed_a);
+    rb_tree_destroy(keyed_b);
+    
+    /* Compaction turns a malloc tree into a pooled one for good */
+    assert(rb_tree_compact(target, RB_LAYOUT_VEB) == RB_OK);
+    key = 4;
+    owned = rb_extract(target, &key, &node);
+    assert(owned && *owned == 4 && node == NULL);
+    free(owned);
+    key = 7;
+    assert(rb_extract(source, &key, &node) != NULL);
+    assert(rb_insert_node(target, node) == RB_ERROR);
+    assert(rb_insert_node(source, node) == RB_OK);
+    
+    rb_tree_destroy(source);
+    rb_tree_destroy(target);
+    
+    printf("Extract test passed!\n\n");
+}
+
+void test_pop_min_max() {
+    printf("=== Testing Pop Min / Pop Max ===\n");
+    
+    rb_tree_t *tree = rb_tree_create(int_compare, free_int);
+    assert(rb_pop_min(tree) == NULL && rb_pop_max(tree) == NULL);
+    
+    /* Keys 0..999 in scrambled order */
+    for (int i = 0; i < 1000; i++) {
+        rb_insert(tree, create_int((i * 7919) % 1000));
+    }
+    assert(*(int *)rb_min(tree) == 0 && *(int *)rb_max(tree) == 999);
+    
+    /* Alternate ends; popped payloads belong to the caller */
+    int low = 0, high = 999;
+    while (!rb_is_empty(tree)) {
+        int *value = rb_pop_min(tree);
+        assert(value && *value == low++);
+        free(value);
+        if (!rb_is_empty(tree)) {
+            value = rb_pop_max(tree);
+            assert(value && *value == high--);
+            free(value);
+        }
+        if (low % 100 == 0) {
+            assert(rb_is_valid(tree));
+            if (!rb_is_empty(tree)) {
+                assert(*(int *)rb_min(tree) == low && *(int *)rb_max(tree) == high);
+            }
+        }
+    }
+    assert(rb_min(tree) == NULL && rb_max(tree) == NULL);
+    
+    /* Extremes follow inserts and deletes at either end */
+    rb_insert(tree, create_int(50));
+    rb_insert(tree, create_int(10));
+    rb_insert(tree, create_int(90));
+    assert(*(int *)rb_min(tree) == 10 && *(int *)rb_max(tree) == 90);
+    int key = 10;
+    rb_delete(tree, &key);
+    key = 90;
+    rb_delete(tree, &key);
+    assert(*(int *)rb_min(tree) == 50 && *(int *)rb_max(tree) == 50);
+    assert(rb_is_valid(tree));
+    rb_tree_destroy(tree);
+    
+    /* Pooled nodes go back to the free list; compaction keeps the extremes */
+    rb_tree_config_t config = {0};
+    config.alloc_mode = RB_ALLOC_POOL;
+    tree = rb_tree_create_ex(int_compare, free_int, &config);
+    for (int i = 0; i < 500; i++) {
+        rb_insert(tree, create_int(i));
+    }
+    assert(rb_tree_compact(tree, RB_LAYOUT_VEB) == RB_OK);
+    assert(rb_is_valid(tree));
+    for (int i = 0; i < 100; i++) {
+        free(rb_pop_min(tree));
+        free(rb_pop_max(tree));
+    }
+    assert(*(int *)rb_min(tree) == 100 && *(int *)rb_max(tree) == 399);
+    assert(rb_size(tree) == 300 && rb_is_valid(tree));
+    rb_tree_destroy(tree);
+    
+    printf("Pop min/max test passed!\n\n");
+}
+
+void test_iterator() {
+    printf("=== Testing Bidirectional Iterator ===\n");
+    
+    rb_tree_t *tree = rb_tree_create(int_compare, free_int);
+    rb_iterator_t iter;
+    rb_iterator_init(&iter, tree);
+    assert(rb_iterator_first(&iter) == NULL && rb_iterator_last(&iter) == NULL);
+    assert(!rb_iterator_has_next(&iter) && !rb_iterator_has_prev(&iter));
+    
+    for (int i = 0; i < 500; i++) {
+        rb_insert(tree, create_int((i * 37) % 500));
+    }
+    
+    int expected = 0;
+    for (int *value = rb_iterator_first(&iter); value; value = rb_iterator_next(&iter)) {
+        assert(*value == expected);
+        assert(rb_iterator_has_next(&iter) == (expected < 499));
+        assert(rb_iterator_has_prev(&iter) == (expected > 0));
+        expected++;
+    }
+    assert(expected == 500);
+    
+    expected = 499;
+    for (int *value = rb_iterator_last(&iter); value; value = rb_iterator_prev(&iter)) {
+        assert(*value == expected--);
+    }
+    assert(expected == -1);
+    
+    /* Change direction mid-scan */
+    int *value = rb_iterator_first(&iter);
+    for (int i = 0; i < 10; i++) {
+        value = rb_iterator_next(&iter);
+    }
+    assert(*value == 10);
+    assert(*(int *)rb_iterator_prev(&iter) == 9);
+    assert(*(int *)rb_iterator_next(&iter) == 10);
+    
+    /* The heap-allocated form behaves the same */
+    rb_iterator_t *heap_iter = rb_iterator_create(tree);
+    assert(*(int *)rb_iterator_last(heap_iter) == 499);
+    assert(rb_iterator_next(heap_iter) == NULL);
+    assert(rb_iterator_next(heap_iter) == NULL);
+    rb_iterator_destroy(heap_iter);
+    
+    rb_tree_destroy(tree);
+    
+    printf("Iterator test passed!\n\n");
+}
+
+void test_range_iterator() {
+    printf("=== Testing Range Iterator ===\n");
+    
+    rb_tree_t *tree = rb_tree_create(int_compare, free_int);
+    rb_range_t range;
+    rb_range_init(&range, tree, NULL, NULL, 0);
+    assert(rb_range_next(&range) == NULL && rb_range_token(&range) == NULL);
+    
+    /* Even keys 0..198 */
+    for (int i = 0; i < 100; i++) {
+        rb_insert(tree, create_int(((i * 37) % 100) * 2));
+    }
+    
+    int lo = 10, hi = 20, odd_lo = 11, odd_hi = 21;
+    int expected;
+    
+    /* Each flag combination, with bounds on and between keys */
+    struct {
+        const int *lo, *hi;
+        unsigned flags;
+        int first, last;
+    } cases[] = {
+        { &lo, &hi, 0, 10, 20 },
+        { &lo, &hi, RB_RANGE_EXCLUDE_LO, 12, 20 },
+        { &lo, &hi, RB_RANGE_EXCLUDE_HI, 10, 18 },
+        { &lo, &hi, RB_RANGE_EXCLUDE_LO | RB_RANGE_EXCLUDE_HI, 12, 18 },
+        { &odd_lo, &odd_hi, RB_RANGE_EXCLUDE_LO | RB_RANGE_EXCLUDE_HI, 12, 20 },
+        { NULL, &hi, 0, 0, 20 },
+        { &lo, NULL, 0, 10, 198 },
+        { NULL, NULL, 0, 0, 198 },
+    };
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        rb_range_init(&range, tree, cases[c].lo, cases[c].hi, cases[c].flags);
+        expected = cases[c].first;
+        for (int *value; (value = rb_range_next(&range)); expected += 2) {
+            assert(*value == expected);
+        }
+        assert(expected == cases[c].last + 2);
+        
+        rb_range_init(&range, tree, cases[c].lo, cases[c].hi, cases[c].flags | RB_RANGE_REVERSE);
+        expected = cases[c].last;
+        for (int *value; (value = rb_range_next(&range)); expected -= 2) {
+            assert(*value == expected);
+        }
+        assert(expected == cases[c].first - 2);
+    }
+    
+    /* Empty ranges */
+    rb_range_init(&range, tree, &hi, &lo, 0);
+    assert(rb_range_next(&range) == NULL);
+    rb_range_init(&range, tree, &lo, &lo, RB_RANGE_EXCLUDE_HI | RB_RANGE_REVERSE);
+    assert(rb_range_next(&range) == NULL);
+    rb_range_init(&range, tree, &odd_lo, &odd_lo, 0);
+    assert(rb_range_next(&range) == NULL);
+    
+    /* Page through [lo, 150] seven at a time, resuming from the last key */
+    int end = 150, token = 0;
+    bool have_token = false;
+    expected = lo;
+    int pages = 0;
+    do {
+        if (have_token) {
+            rb_range_resume(&range, tree, &token, &end, 0);
+        } else {
+            rb_range_init(&range, tree, &lo, &end, 0);
+        }
+        int count = 0;
+        int *value;
+        while (count < 7 && (value = rb_range_next(&range))) {
+            assert(*value == expected);
+            expected += 2;
+            count++;
+        }
+        if (count == 0) {
+            break;
+        }
+        /* Copy the token so the page's elements may be deleted */
+        token = *(const int *)rb_range_token(&range);
+        have_token = true;
+        pages++;
+        rb_delete(tree, &token);
+    } while (true);
+    assert(expected == end + 2);
+    assert(pages == (end - lo) / 2 / 7 + 1);
+    
+    /* Reverse paging resumes below the token */
+    token = 100;
+    rb_range_resume(&range, tree, &token, NULL, RB_RANGE_REVERSE);
+    assert(*(int *)rb_range_next(&range) == 98);
+    rb_range_resume(&range, tree, NULL, NULL, RB_RANGE_REVERSE);
+    assert(*(int *)rb_range_next(&range) == 198);
+    
+    rb_tree_destroy(tree);
+    
+    printf("Range iterator test passed!\n\n");
+}
+
+void test_order_statistics() {
+    printf("=== Testing Order Statistics ===\n");
+    
+    rb_tree_config_t config = {0};
+    config.order_statistics = true;
+    config.alloc_mode = RB_ALLOC_INTRUSIVE;
+    assert(rb_tree_create_ex(int_compare, free_int, &config) == NULL);
+    
+    /* Same operations on an augmented pooled tree and a plain tree; the
+     * plain one exercises the walking fallbacks */
+    config.alloc_mode = RB_ALLOC_POOL;
+    rb_tree_t *trees[2] = {
+        rb_tree_create_ex(int_compare, free_int, &config),
+        rb_tree_create(int_compare, free_int)
+    };
+    bool present[1000] = {false};
+    
+    for (int round = 0; round < 4000; round++) {
+        int key = (round * 7919) % 1000;
+        bool remove = (round % 3 == 2);
+        for (int t = 0; t < 2; t++) {
+            if (remove) {
+                rb_delete(trees[t], &key);
+            } else {
+                int *value = create_int(key);
+                if (rb_insert(trees[t], value) != RB_OK) {
+                    free(value);
+                }
+            }
+        }
+        present[key] = !remove;
+        
+        if (round % 500 == 499) {
+            assert(rb_is_valid(trees[0]) && rb_is_valid(trees[1]));
+            size_t below = 0;
+            for (int k = 0; k < 1000; k++) {
+                for (int t = 0; t < 2; t++) {
+                    assert(rb_rank(trees[t], &k) == below);
+                }
+                if (present[k]) {
+                    for (int t = 0; t < 2; t++) {
+                        assert(*(int *)rb_select(trees[t], below) == k);
+                        assert(rb_node_rank(trees[t], rb_lower_bound_node(trees[t], &k)) == below);
+                    }
+                    below++;
+                }
+            }
+            assert(below == rb_size(trees[0]));
+            assert(rb_select(trees[0], below) == NULL && rb_node_rank(trees[0], NULL) == below);
+            
+            /* Inclusive range counts, including empty and inverted ranges */
+            for (int lo = -5; lo < 1005; lo += 37) {
+                for (int hi = lo - 20; hi < 1010; hi += 53) {
+                    size_t expected = 0;
+                    for (int k = (lo < 0 ? 0 : lo); k <= hi && k < 1000; k++) {
+                        expected += present[k];
+                    }
+                    assert(rb_count_range(trees[0], &lo, &hi) == expected);
+                    assert(rb_count_range(trees[1], &lo, &hi) == expected);
+                }
+            }
+        }
+    }
+    
+    /* Median and percentiles */
+    size_t n = rb_size(trees[0]);
+    int *median = rb_select(trees[0], n / 2);
+    assert(rb_rank(trees[0], median) == n / 2);
+    assert(*(int *)rb_select(trees[0], 0) == *(int *)rb_min(trees[0]));
+    assert(*(int *)rb_select(trees[0], n - 1) == *(int *)rb_max(trees[0]));
+    
+    /* Sizes survive pops, compaction and sorted inserts */
+    free(rb_pop_min(trees[0]));
+    free(rb_pop_max(trees[0]));
+    assert(rb_tree_compact(trees[0], RB_LAYOUT_VEB) == RB_OK);
+    int *batch[50];
+    for (int i = 0; i < 50; i++) {
+        batch[i] = create_int(2000 + i);
+    }
+    size_t inserted;
+    assert(rb_insert_sorted(trees[0], (void *const *)batch, 50, &inserted) == RB_OK);
+    assert(rb_is_valid(trees[0]));
+    assert(rb_rank(trees[0], batch[10]) == n - 2 + 10);
+    assert(*(int *)rb_select(trees[0], n - 2 + 49) == 2049);
+    
+    /* Inline keys with order statistics */
+    rb_tree_config_t keyed_config = {0};
+    keyed_config.key_type = RB_KEY_INT64;
+    keyed_config.order_statistics = true;
+    rb_tree_t *keyed = rb_tree_create_ex(NULL, free_int, &keyed_config);
+    for (int64_t i = 0; i < 100; i++) {
+        int64_t key = i * 10;
+        rb_insert_key(keyed, &key, create_int((int)key));
+    }
+    int64_t probe = 455;
+    assert(rb_rank(keyed, &probe) == 46);
+    assert(*(const int64_t *)rb_node_key(keyed, rb_select_node(keyed, 46)) == 460);
+    
+    rb_tree_destroy(keyed);
+    rb_tree_destroy(trees[0]);
+    rb_tree_destroy(trees[1]);
+    
+    printf("Order statistics test passed!\n\n");
+}
+
+/* Non-commutative aggregate: first and last element as well as totals, so
+ * a fold in the wrong order is caught */
+typedef struct {
+    int64_t count;
+    int64_t sum;
+    int64_t first;
+    int64_t last;
+} span_t;
+
+static void span_value(void *out, const void *data) {
+    span_t *span = out;
+    span->count = 1;
+    span->sum = *(const int *)data;
+    span->first = span->last = *(const int *)data;
+}
+
+static void span_combine(void *acc, const void *next) {
+    span_t *a = acc;
+    const span_t *b = next;
+    if (b->count == 0) {
+        return;
+    }
+    if (a->count == 0) {
+        a->first = b->first;
+    }
+    a->last = b->last;
+    a->count += b->count;
+    a->sum += b->sum;
+}
+
+static void check_spans(rb_tree_t *tree, const bool *present, int limit) {
+    for (int lo = -3; lo < limit + 3; lo += 29) {
+        for (int hi = lo - 10; hi < limit + 5; hi += 41) {
+            span_t expected = {0, 0, 0, 0};
+            for (int k = (lo < 0 ? 0 : lo); k <= hi && k < limit; k++) {
+                if (present[k]) {
+                    span_t single;
+                    span_value(&single, &k);
+                    span_combine(&expected, &single);
+                }
+            }
+            span_t span;
+            assert(rb_aggregate_range(tree, &lo, &hi, &span) == RB_OK);
+            assert(span.count == expected.count && span.sum == expected.sum);
+            if (expected.count) {
+                assert(span.first == expected.first && span.last == expected.last);
+            }
+        }
+    }
+}
+
+void test_aggregates() {
+    printf("=== Testing Subtree Aggregates ===\n");
+    
+    static const span_t empty_span = {0, 0, 0, 0};
+    rb_tree_config_t config = {0};
+    config.augment.size = sizeof(span_t);
+    config.augment.identity = &empty_span;
+    config.augment.value = span_value;
+    config.augment.combine = span_combine;
+    
+    /* Incomplete descriptors and intrusive trees are rejected */
+    rb_tree_config_t bad = config;
+    bad.augment.combine = NULL;
+    assert(rb_tree_create_ex(int_compare, free_int, &bad) == NULL);
+    bad = config;
+    bad.alloc_mode = RB_ALLOC_INTRUSIVE;
+    assert(rb_tree_create_ex(int_compare, free_int, &bad) == NULL);
+    
+    span_t span;
+    rb_tree_t *plain = rb_tree_create(int_compare, free_int);
+    assert(rb_aggregate_range(plain, NULL, NULL, &span) == RB_ERROR);
+    rb_tree_destroy(plain);
+    
+    /* Malloc'd, pooled, and pooled alongside subtree sizes */
+    for (int variant = 0; variant < 3; variant++) {
+        rb_tree_config_t tree_config = config;
+        tree_config.alloc_mode = variant ? RB_ALLOC_POOL : RB_ALLOC_MALLOC;
+        tree_config.order_statistics = (variant == 2);
+        rb_tree_t *tree = rb_tree_create_ex(int_compare, free_int, &tree_config);
+        bool present[600] = {false};
+        
+        assert(rb_aggregate_range(tree, NULL, NULL, &span) == RB_OK && span.count == 0);
+        
+        for (int round = 0; round < 3000; round++) {
+            int key = (round * 7919) % 600;
+            if (round % 3 == 2) {
+                rb_delete(tree, &key);
+                present[key] = false;
+            } else {
+                int *value = create_int(key);
+                if (rb_insert(tree, value) == RB_OK) {
+                    present[key] = true;
+                } else {
+                    free(value);
+                }
+            }
+            if (round % 600 == 599) {
+                assert(rb_is_valid(tree));
+                check_spans(tree, present, 600);
+            }
+        }
+        
+        /* Whole-tree and open-ended folds */
+        int64_t total = 0, count = 0;
+        for (int k = 0; k < 600; k++) {
+            if (present[k]) {
+                total += k;
+                count++;
+            }
+        }
+        assert(rb_aggregate_range(tree, NULL, NULL, &span) == RB_OK);
+        assert(span.count == count && span.sum == total);
+        assert(span.first == *(int *)rb_min(tree) && span.last == *(int *)rb_max(tree));
+        int mid = 300;
+        span_t below, above;
+        rb_aggregate_range(tree, NULL, &mid, &below);
+        rb_aggregate_range(tree, &mid, NULL, &above);
+        assert(below.sum + above.sum - (present[mid] ? mid : 0) == total);
+        
+        /* Pops, compaction and payload swaps keep the aggregates */
+        free(rb_pop_min(tree));
+        free(rb_pop_max(tree));
+        rb_tree_compact(tree, RB_LAYOUT_BFS);
+        rb_aggregate_range(tree, NULL, NULL, &span);
+        assert(span.count == count - 2);
+        
+        int *probe = rb_select(tree, rb_size(tree) / 2);
+        int key = *probe;
+        void *replaced;
+        assert(rb_upsert(tree, create_int(key), &replaced) == RB_OK && replaced == probe);
+        free(replaced);
+        rb_aggregate_range(tree, &key, &key, &span);
+        assert(span.count == 1 && span.sum == key);
+        
+        int missing = -1;
+        assert(rb_aggregate_refresh(tree, &missing) == RB_NOT_FOUND);
+        assert(rb_is_valid(tree));
+        
+        rb_tree_destroy(tree);
+    }
+    
+    /* Inline keys: payloads are independent of the keys, so an in-place
+     * edit must be refreshed */
+    config.key_type = RB_KEY_INT64;
+    rb_tree_t *keyed = rb_tree_create_ex(NULL, free_int, &config);
+    for (int64_t k = 0; k < 100; k++) {
+        rb_insert_key(keyed, &k, create_int(1));
+    }
+    int64_t lo = 10, hi = 19;
+    rb_aggregate_range(keyed, &lo, &hi, &span);
+    assert(span.count == 10 && span.sum == 10);
+    
+    int64_t key = 15;
+    *(int *)rb_search(keyed, &key) = 1000;
+    assert(rb_aggregate_refresh(keyed, &key) == RB_OK);
+    rb_aggregate_range(keyed, &lo, &hi, &span);
+    assert(span.sum == 1009 && span.first == 1 && span.last == 1);
+    rb_aggregate_range(keyed, NULL, NULL, &span);
+    assert(span.count == 100 && span.sum == 1099);
+    
+    /* Replacing a payload propagates too */
+    key = 50;
+    void *old_payload;
+    assert(rb_upsert_key(keyed, &key, create_int(-99), &old_payload) == RB_OK);
+    free(old_payload);
+    rb_aggregate_range(keyed, NULL, NULL, &span);
+    assert(span.count == 100 && span.sum == 999);
+    assert(rb_is_valid(keyed));
+    rb_tree_destroy(keyed);
+    
+    printf("Aggregate test passed!\n\n");
+}
+
 int main() {
     printf("Red-Black Tree Implementation Test Suite\n");
     printf("==========================================\n\n");
@@ -228,6 +2075,30 @@ int main() {
     test_edge_cases();
     test_large_dataset();
     test_string_data();
+    test_pool_allocator();
+    test_intrusive_nodes();
+    test_keyed_trees();
+    test_index_tree();
+    test_arena_trees();
+    test_compaction();
+    test_memory_accounting();
+    test_hugepage_trees();
+    test_search_batch();
+    test_sorted_batches();
+    test_lookup_cache();
+    test_frozen_snapshot();
+    test_static_btree();
+    test_string_keys();
+    test_bloom_filter();
+    test_bound_queries();
+    test_hinted_insert();
+    test_upsert_and_emplace();
+    test_extract();
+    test_pop_min_max();
+    test_iterator();
+    test_range_iterator();
+    test_order_statistics();
+    test_aggregates();
     
     printf("All tests passed successfully!\n");
     return 0;